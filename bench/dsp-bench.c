@@ -0,0 +1,314 @@
+// times the sample conversions of src/util/dsp.c over 2 to 64 channels, `make bench` builds and runs it.
+// standalone on purpose, it needs neither sndio nor a device.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dsp.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+// frames per call, about what a period is between sio_writes
+#define FRAMES 1024
+
+// how long each case runs, long enough for the clock and short enough for a quick run of all of them
+#define RUN_NS (uint64_t)2e8
+
+static const int channels[] = { 2, 4, 6, 8, 16, 32, 64 };
+
+static adata_t adata[FRAMES * NCHAN_MAX], adata_out[(FRAMES + FRAMES / 8) * NCHAN_MAX], adata_ref[FRAMES * NCHAN_MAX];
+static unsigned char encoded[FRAMES * NCHAN_MAX * 8];
+static adata_t resamp_ctx[NCHAN_MAX * RESAMP_NCTX];
+
+struct state {
+   struct conv conv;
+   struct resamp resamp;
+   struct cmap cmap;
+   struct cmat cmat;
+   const unsigned char *perm;
+   int nch, vol;
+};
+
+static uint64_t
+get_time_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * (uint64_t)1e9 + (uint64_t)ts.tv_nsec;
+}
+
+static void
+fill(void)
+{
+   // a full scale ramp per channel, so nothing is zero and nothing saturates by accident
+   for (size_t i = 0; i < ARRAY_SIZE(adata); ++i)
+      adata[i] = (adata_t)((int)((i * 2654435761u) % (2 * ADATA_UNIT)) - ADATA_UNIT);
+
+   for (size_t i = 0; i < sizeof(encoded); ++i)
+      encoded[i] = (unsigned char)(i * 31);
+}
+
+static void
+measure(const char *name, struct state *s, void (*fn)(struct state *s))
+{
+   // repeat until RUN_NS passed, one warm up call first so the tables and caches are in
+   fn(s);
+
+   uint64_t calls = 0;
+   const uint64_t start = get_time_ns();
+   uint64_t elapsed;
+   do {
+      for (int i = 0; i < 64; ++i)
+         fn(s);
+      calls += 64;
+   } while ((elapsed = get_time_ns() - start) < RUN_NS);
+
+   const double ns_frame = (double)elapsed / (double)(calls * FRAMES);
+   printf("%-20s %3d ch %9.2f ns/frame %7.3f ns/sample\n", name, s->nch, ns_frame, ns_frame / s->nch);
+}
+
+static void
+dec_linear(struct state *s)
+{
+   dec_do(&s->conv, encoded, (unsigned char*)adata_out, FRAMES);
+}
+
+static void
+dec_float(struct state *s)
+{
+   dec_do_float(&s->conv, encoded, (unsigned char*)adata_out, FRAMES);
+}
+
+static void
+enc_linear(struct state *s)
+{
+   enc_do(&s->conv, (unsigned char*)adata, encoded, FRAMES);
+}
+
+static void
+enc_float(struct state *s)
+{
+   enc_do_float(&s->conv, (unsigned char*)adata, encoded, FRAMES);
+}
+
+static void
+resamp(struct state *s)
+{
+   int icnt = FRAMES, ocnt = ARRAY_SIZE(adata_out) / s->nch;
+   resamp_getcnt(&s->resamp, &icnt, &ocnt);
+   resamp_do(&s->resamp, adata, adata_out, icnt, ocnt);
+}
+
+// cmap_add and cmap_copy before the flat kernels, frame by frame
+static void
+loop_add(struct cmap *p, adata_t *idata, adata_t *odata, int vol, int todo)
+{
+   for (int i = todo; i > 0; i--) {
+      odata += p->ostart;
+      idata += p->istart;
+      for (int j = p->nch; j > 0; j--) {
+         int y = *odata + ADATA_MUL(*idata, vol);
+         *odata++ = (y >= ADATA_UNIT ? ADATA_UNIT - 1 : (y < -ADATA_UNIT ? -ADATA_UNIT : y));
+         idata++;
+      }
+      odata += p->onext;
+      idata += p->inext;
+   }
+}
+
+static void
+loop_copy(struct cmap *p, adata_t *idata, adata_t *odata, int vol, int todo)
+{
+   for (int i = todo; i > 0; i--) {
+      odata += p->ostart;
+      idata += p->istart;
+      for (int j = p->nch; j > 0; j--)
+         *odata++ = ADATA_MUL(*idata++, vol);
+      odata += p->onext;
+      idata += p->inext;
+   }
+}
+
+static void
+cmap_add_new(struct state *s)
+{
+   cmap_add(&s->cmap, adata, adata_out, s->vol, FRAMES);
+}
+
+static void
+cmap_add_loop(struct state *s)
+{
+   loop_add(&s->cmap, adata, adata_out, s->vol, FRAMES);
+}
+
+static void
+cmap_copy_new(struct state *s)
+{
+   cmap_copy(&s->cmap, adata, adata_out, s->vol, FRAMES);
+}
+
+static void
+cmap_copy_loop(struct state *s)
+{
+   loop_copy(&s->cmap, adata, adata_out, s->vol, FRAMES);
+}
+
+// cmat_do without SIMD and with every coefficient, the sums it has to match
+static void
+cmat_loop(struct state *s)
+{
+   const struct cmat *p = &s->cmat;
+   adata_t *idata = adata, *odata = adata_out;
+   for (int f = FRAMES; f > 0; f--, idata += p->nin) {
+      for (int j = 0; j < p->nout; j++) {
+         long long y = 0;
+         for (int i = 0; i < p->nin; i++)
+            y += (long long)idata[i] * p->coef[j * p->nin + i];
+         y >>= CMAT_SHIFT;
+         *odata++ = (y >= ADATA_UNIT ? ADATA_UNIT - 1 : (y < -ADATA_UNIT ? -ADATA_UNIT : y));
+      }
+   }
+}
+
+static void
+cmat_new(struct state *s)
+{
+   cmat_do(&s->cmat, adata, adata_out, FRAMES);
+}
+
+// chmap_swizzle before cperm_do, in place frame by frame
+static void
+cperm_loop(struct state *s)
+{
+   adata_t frame[CMAT_NCHAN_MAX], *data = adata_out;
+   for (int f = FRAMES; f > 0; f--, data += s->nch) {
+      memcpy(frame, data, s->nch * sizeof(*data));
+      for (int c = 0; c < s->nch; c++)
+         data[c] = frame[s->perm[c]];
+   }
+}
+
+static void
+cperm_new(struct state *s)
+{
+   cperm_do(s->perm, s->nch, adata_out, FRAMES);
+}
+
+static void
+check(const char *name, struct state *s, void (*fn)(struct state *s), void (*ref)(struct state *s))
+{
+   // the kernels have to give what the loops gave, mixing onto something that saturates in places
+   for (size_t i = 0; i < (size_t)FRAMES * s->nch; ++i)
+      adata_out[i] = adata[(i * 7) % ARRAY_SIZE(adata)];
+   ref(s);
+   memcpy(adata_ref, adata_out, sizeof(adata_t) * FRAMES * s->nch);
+
+   for (size_t i = 0; i < (size_t)FRAMES * s->nch; ++i)
+      adata_out[i] = adata[(i * 7) % ARRAY_SIZE(adata)];
+   fn(s);
+
+   if (memcmp(adata_ref, adata_out, sizeof(adata_t) * FRAMES * s->nch)) {
+      fprintf(stderr, "%s: %d ch, vol %d differs from the loop\n", name, s->nch, s->vol);
+      exit(EXIT_FAILURE);
+   }
+}
+
+static void
+measure_cmap(const char *name, struct state *s, void (*fn)(struct state *s), void (*ref)(struct state *s))
+{
+   check(name, s, fn, ref);
+
+   char loop_name[32];
+   snprintf(loop_name, sizeof(loop_name), "%s loop", name);
+   measure(name, s, fn);
+   measure(loop_name, s, ref);
+}
+
+static void
+measure_cmat(const char *name, const int nin, const int nout, const int *coef)
+{
+   // per output frame, the number of channels printed is the output's
+   struct state s = { .nch = nout };
+   cmat_init(&s.cmat, nin, nout);
+   memcpy(s.cmat.coef, coef, sizeof(int) * nin * nout);
+   measure_cmap(name, &s, cmat_new, cmat_loop);
+}
+
+static void
+measure_cperm(const char *name, const int nch, const unsigned char *perm)
+{
+   struct state s = { .nch = nch, .perm = perm };
+   measure_cmap(name, &s, cperm_new, cperm_loop);
+}
+
+int
+main(void)
+{
+   // S16_LE, S24_LE (24 bits in 4 bytes) and FLOAT_LE as the pcm describes them
+   struct aparams s16le = { .bps = 2, .bits = 16, .le = 1, .sig = 1, .msb = 1 };
+   struct aparams s24le = { .bps = 4, .bits = 24, .le = 1, .sig = 1, .msb = 0 };
+   struct aparams float_le = { .bps = 4, .bits = 32, .le = 1, .sig = 1, .msb = 1 };
+
+   fill();
+   printf("ADATA_BITS %d, %d frames per call\n", ADATA_BITS, FRAMES);
+
+   for (size_t c = 0; c < ARRAY_SIZE(channels); ++c) {
+      struct state s = { .nch = channels[c] };
+
+      dec_init(&s.conv, &s16le, s.nch);
+      measure("decode s16le", &s, dec_linear);
+      dec_init(&s.conv, &s24le, s.nch);
+      measure("decode s24le", &s, dec_linear);
+      dec_init(&s.conv, &float_le, s.nch);
+      measure("decode float", &s, dec_float);
+
+      enc_init(&s.conv, &s16le, s.nch);
+      measure("encode s16le", &s, enc_linear);
+      enc_init(&s.conv, &s24le, s.nch);
+      measure("encode s24le", &s, enc_linear);
+      enc_init(&s.conv, &float_le, s.nch);
+      measure("encode float", &s, enc_float);
+
+      s.resamp.ctx = resamp_ctx;
+      resamp_init(&s.resamp, 44100, 48000, s.nch);
+      measure("resamp 44100>48000", &s, resamp);
+      resamp_init(&s.resamp, 48000, 44100, s.nch);
+      measure("resamp 48000>44100", &s, resamp);
+
+      cmap_init(&s.cmap, 0, s.nch - 1, 0, s.nch - 1, 0, s.nch - 1, 0, s.nch - 1);
+      s.vol = ADATA_UNIT;
+      measure_cmap("cmap add", &s, cmap_add_new, cmap_add_loop);
+      measure_cmap("cmap copy", &s, cmap_copy_new, cmap_copy_loop);
+      s.vol = ADATA_UNIT / 3;
+      measure_cmap("cmap add vol", &s, cmap_add_new, cmap_add_loop);
+      measure_cmap("cmap copy vol", &s, cmap_copy_new, cmap_copy_loop);
+      putchar('\n');
+   }
+
+   // the remix matrices of pcm.c: 5.1 and 7.1 down to stereo with the center and rears at -3dB, and
+   // stereo up to 5.1 where only the fronts get anything. one more that saturates.
+   const int h = 11585, u = CMAT_UNIT;
+   const int down6[] = { u, 0, h, 0, h, 0, 0, u, h, 0, 0, h };
+   const int down8[] = { u, 0, h, 0, h, 0, h, 0, 0, u, h, 0, 0, h, 0, h };
+   const int up6[] = { u, 0, 0, u, 0, 0, 0, 0, 0, 0, 0, 0 };
+   const int loud[] = { u, u, -u, u, u, -u, u, u };
+   measure_cmat("cmat 6>2", 6, 2, down6);
+   measure_cmat("cmat 8>2", 8, 2, down8);
+   measure_cmat("cmat 2>6", 2, 6, up6);
+   measure_cmat("cmat 2>4 loud", 2, 4, loud);
+   putchar('\n');
+
+   // snd_pcm_set_chmap orders: swapped stereo, quad with the rears first, 5.1 and 7.1 with the center
+   // and LFE before the rears, and a 3 channel one that doesn't fit a vector a whole number of times
+   static const unsigned char swap2[] = { 1, 0 }, perm3[] = { 2, 0, 1 }, perm4[] = { 2, 3, 0, 1 };
+   static const unsigned char perm6[] = { 0, 1, 4, 5, 2, 3 }, perm8[] = { 0, 1, 4, 5, 2, 3, 7, 6 };
+   measure_cperm("cperm swap", 2, swap2);
+   measure_cperm("cperm 3", 3, perm3);
+   measure_cperm("cperm 4", 4, perm4);
+   measure_cperm("cperm 5.1", 6, perm6);
+   measure_cperm("cperm 7.1", 8, perm8);
+
+   return 0;
+}
@@ -12,7 +12,7 @@ ret_type_for()
 
 fun_name_for()
 {
-   filter_classifiers <<<"$1" | sed 's/struct//;s/const//;s/unsigned//;s/^[\t ]*//;s/[a-zA-Z0-9_]\+[\t \*]*//' | grep -Eo '^[a-zA-Z0-9_]+'
+   filter_classifiers <<<"$1" | sed 's/\bstruct\b//;s/\bconst\b//;s/\bunsigned\b//;s/^[\t ]*//;s/[a-zA-Z0-9_]\+[\t \*]*//' | grep -Eo '^[a-zA-Z0-9_]+'
 }
 
 should_error()
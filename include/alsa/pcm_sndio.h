@@ -0,0 +1,126 @@
+/**
+ * \file include/pcm_sndio.h
+ * \brief sndio specific PCM extensions
+ *
+ * Functionality of libasound-sndio that has no equivalent in the ALSA API.
+ * Not included by asoundlib.h, include explicitly.
+ *
+ * Playback PCMs opened as "dmix", or as "default" with ASOUND_DMIX set, are mixed in process onto a single
+ * sndio stream. Likewise capture PCMs opened as "dsnoop" (or ASOUND_DSNOOP) all read one recording, each in
+ * its own format. They run at the shared stream's rate with at most its channels, and all of them have to be
+ * used from the same thread. Mixing and reading happen whenever any of them is called, the shared stream keeps
+ * sndiod's default buffer and is mixed ahead as far as every running PCM has frames queued, so it only lasts
+ * while nothing is called for as long as the PCMs' own buffers allow.
+ *
+ * A playback PCM opened as "multi:dev1,dev2,..." spreads its channels over the listed sndio devices, in order.
+ * The first device is the clock the others are resampled to follow, by at most 1%.
+ */
+
+#ifndef __ALSA_PCM_SNDIO_H
+#define __ALSA_PCM_SNDIO_H
+
+#include "pcm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Get the estimated sound card clock speed relative to CLOCK_MONOTONIC
+ * \param pcm PCM handle
+ * \param ratio Returned ratio, > 1.0 means the card consumes/produces frames faster than its nominal rate
+ * \return 0 on success, negative if the estimate has not settled yet (stream not running long enough)
+ */
+int snd_pcm_sndio_get_rate_ratio(snd_pcm_t *pcm, double *ratio);
+
+/**
+ * \brief Get the clock ratio captured by #snd_pcm_status
+ * \param obj Status container
+ * \return ratio, 1.0 if no estimate was available
+ */
+double snd_pcm_sndio_status_get_rate_ratio(const snd_pcm_status_t *obj);
+
+/**
+ * \brief Hold back the newest written frames from sndio so #snd_pcm_rewind can still take them back
+ * \param pcm PCM handle
+ * \param frames Frames to hold back, 0 (the default) hands everything to sndio right away
+ * \return 0 on success, negative on capture streams
+ *
+ * The window is limited so the device keeps at least two periods. It only applies once the stream
+ * is running: sndio doesn't start playing before its buffer is full, so until the first position
+ * update everything written is handed over. While frames are held back, poll wakeups follow
+ * sndiod's position updates instead of the device becoming writable.
+ * The ASOUND_REWIND_MS environment variable sets a default window for apps that don't call this.
+ */
+int snd_pcm_sndio_set_rewind_window(snd_pcm_t *pcm, snd_pcm_uframes_t frames);
+
+/**
+ * \brief Get the effective rewind window
+ * \param pcm PCM handle
+ * \param frames Returned window in frames, after limiting it to the current buffer
+ * \return 0 on success
+ */
+int snd_pcm_sndio_get_rewind_window(snd_pcm_t *pcm, snd_pcm_uframes_t *frames);
+
+/**
+ * \brief Let the effective playback buffer follow how stable the stream is
+ * \param pcm PCM handle
+ * \param min Smallest effective buffer in frames, at least two periods
+ * \param max Largest effective buffer in frames, 0 turns the controller off
+ * \return 0 on success, negative on capture streams or if min > max
+ *
+ * Starts at max, grows by half after every underrun and shrinks a period at a time after each
+ * five seconds where the device stayed more than two periods ahead. Only avail is limited,
+ * sndio keeps the negotiated buffer and the effective buffer never exceeds it. The limit only
+ * applies once the stream is running, sndio doesn't start playing before its buffer is full.
+ * The ASOUND_ADAPTIVE_MIN_MS environment variable turns it on with the negotiated buffer as max.
+ */
+int snd_pcm_sndio_set_adaptive_buffer(snd_pcm_t *pcm, snd_pcm_uframes_t min, snd_pcm_uframes_t max);
+
+/**
+ * \brief Get the effective playback buffer
+ * \param pcm PCM handle
+ * \param frames Returned size in frames, the negotiated buffer size if the controller is off
+ * \return 0 on success
+ */
+int snd_pcm_sndio_get_adaptive_buffer(snd_pcm_t *pcm, snd_pcm_uframes_t *frames);
+
+/**
+ * \brief Write interleaved frames so the first one plays at the given time
+ * \param pcm PCM handle
+ * \param buffer Frames containing buffer
+ * \param size Frames to be written
+ * \param tstamp CLOCK_MONOTONIC time the first frame should reach the device
+ * \return frames consumed from buffer (written or dropped), otherwise like #snd_pcm_writei
+ *
+ * The offset to what is already queued comes from the position estimate, so it's as accurate as
+ * the clock estimate (see #snd_pcm_sndio_get_rate_ratio) and rounded to the nearest frame. Up to
+ * then silence is written. Frames that would play before the time are dropped. A prepared stream is
+ * started. sndio only starts playing once its buffer is full, so a stream that isn't playing yet is first
+ * filled up with silence. That fails with -EBADFD when the device buffer is bigger than the PCM's (after
+ * a shorter buffer was set on a running stream), write until it plays instead. In non-blocking mode
+ * -EAGAIN means only part of the silence fit, retry with the same time.
+ */
+snd_pcm_sframes_t snd_pcm_sndio_writei_at(snd_pcm_t *pcm, const void *buffer, snd_pcm_uframes_t size, const snd_htimestamp_t *tstamp);
+
+/**
+ * \brief Get the number of xruns (underruns for playback, overruns for capture) since the PCM was opened
+ * \param pcm PCM handle
+ * \param xruns Returned count
+ * \return 0 on success
+ */
+int snd_pcm_sndio_get_xruns(snd_pcm_t *pcm, unsigned long *xruns);
+
+/**
+ * \brief Get the number of frames the other devices of a "multi:" PCM had no room for since it was opened
+ * \param pcm PCM handle
+ * \param frames Returned count, summed over the devices, always 0 for other PCMs
+ * \return 0 on success
+ */
+int snd_pcm_sndio_get_dropped(snd_pcm_t *pcm, snd_pcm_uframes_t *frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ALSA_PCM_SNDIO_H */
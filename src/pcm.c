@@ -1,7 +1,12 @@
 #include <alsa/asoundlib.h>
+#include <alsa/pcm_sndio.h>
 #include <sndio.h>
 #include <poll.h>
+#include <ctype.h>
+#include <errno.h>
+#include <strings.h>
 #include <stdbool.h>
+#include <limits.h>
 #include <assert.h>
 #include "util/dsp.h"
 #include "util/util.h"
@@ -11,39 +16,198 @@ static const snd_pcm_access_t SUPPORTED_ACCESS[] = {
    SND_PCM_ACCESS_RW_INTERLEAVED
 };
 
+// how the app's samples are turned into adata_t, sndio only does linear integers
+enum codec {
+   CODEC_NONE, // described for the format helpers, can't be played or recorded
+   CODEC_LINEAR,
+   CODEC_FLOAT,
+   CODEC_FLOAT64,
+   CODEC_MU_LAW,
+   CODEC_A_LAW,
+};
+
+// the formats sndio takes as they are, with alsa's width, physical width, signedness and byte order (-1 for
+// single bytes) followed by the bits and msb sndio describes them with
+#define LINEAR_FORMATS(X) \
+   X(S8, 8, 8, 1, -1, 8, 1, "Signed 8 bit") \
+   X(U8, 8, 8, 0, -1, 8, 1, "Unsigned 8 bit") \
+   X(S16_LE, 16, 16, 1, 1, 16, 1, "Signed 16 bit Little Endian") \
+   X(S16_BE, 16, 16, 1, 0, 16, 1, "Signed 16 bit Big Endian") \
+   X(U16_LE, 16, 16, 0, 1, 16, 1, "Unsigned 16 bit Little Endian") \
+   X(U16_BE, 16, 16, 0, 0, 16, 1, "Unsigned 16 bit Big Endian") \
+   X(S24_LE, 24, 32, 1, 1, 24, 0, "Signed 24 bit Little Endian") \
+   X(S24_BE, 24, 32, 1, 0, 24, 0, "Signed 24 bit Big Endian") \
+   X(U24_LE, 24, 32, 0, 1, 24, 0, "Unsigned 24 bit Little Endian") \
+   X(U24_BE, 24, 32, 0, 0, 24, 0, "Unsigned 24 bit Big Endian") \
+   X(S32_LE, 32, 32, 1, 1, 24, 1, "Signed 32 bit Little Endian") \
+   X(S32_BE, 32, 32, 1, 0, 24, 1, "Signed 32 bit Big Endian") \
+   X(U32_LE, 32, 32, 0, 1, 24, 1, "Unsigned 32 bit Little Endian") \
+   X(U32_BE, 32, 32, 0, 0, 24, 1, "Unsigned 32 bit Big Endian") \
+   X(S20_LE, 20, 32, 1, 1, 20, 0, "Signed 20 bit Little Endian in 4 bytes, LSB justified") \
+   X(S20_BE, 20, 32, 1, 0, 20, 0, "Signed 20 bit Big Endian in 4 bytes, LSB justified") \
+   X(U20_LE, 20, 32, 0, 1, 20, 0, "Unsigned 20 bit Little Endian in 4 bytes, LSB justified") \
+   X(U20_BE, 20, 32, 0, 0, 20, 0, "Unsigned 20 bit Big Endian in 4 bytes, LSB justified") \
+   X(S24_3LE, 24, 24, 1, 1, 24, 1, "Signed 24 bit Little Endian in 3bytes") \
+   X(S24_3BE, 24, 24, 1, 0, 24, 1, "Signed 24 bit Big Endian in 3bytes") \
+   X(U24_3LE, 24, 24, 0, 1, 24, 1, "Unsigned 24 bit Little Endian in 3bytes") \
+   X(U24_3BE, 24, 24, 0, 0, 24, 1, "Unsigned 24 bit Big Endian in 3bytes") \
+   X(S20_3LE, 20, 24, 1, 1, 20, 0, "Signed 20 bit Little Endian in 3bytes") \
+   X(S20_3BE, 20, 24, 1, 0, 20, 0, "Signed 20 bit Big Endian in 3bytes") \
+   X(U20_3LE, 20, 24, 0, 1, 20, 0, "Unsigned 20 bit Little Endian in 3bytes") \
+   X(U20_3BE, 20, 24, 0, 0, 20, 0, "Unsigned 20 bit Big Endian in 3bytes") \
+   X(S18_3LE, 18, 24, 1, 1, 18, 0, "Signed 18 bit Little Endian in 3bytes") \
+   X(S18_3BE, 18, 24, 1, 0, 18, 0, "Signed 18 bit Big Endian in 3bytes") \
+   X(U18_3LE, 18, 24, 0, 1, 18, 0, "Unsigned 18 bit Little Endian in 3bytes") \
+   X(U18_3BE, 18, 24, 0, 0, 18, 0, "Unsigned 18 bit Big Endian in 3bytes")
+
+// indexed by the format, the gaps in the enum have no name
 static const struct format_info {
-   const char *name;
+   const char *name, *description;
    snd_pcm_format_t fmt;
-   struct sio_enc enc;
-} SUPPORTED_FORMATS[] = {
-#define FMT(F, BITS, BPS, SIG, LE, MSB) { .name = #F, .fmt = F, .enc = { .bits = BITS, .bps = BPS, .sig = SIG, .le = LE, .msb = MSB } }
-   FMT(SND_PCM_FORMAT_S8, 8, 1, 1, 1, 1),
-   FMT(SND_PCM_FORMAT_U8, 8, 1, 0, 1, 1),
-   FMT(SND_PCM_FORMAT_S16_LE, 16, 2, 1, 1, 1),
-   FMT(SND_PCM_FORMAT_S16_BE, 16, 2, 1, 0, 1),
-   FMT(SND_PCM_FORMAT_U16_LE, 16, 2, 0, 1, 1),
-   FMT(SND_PCM_FORMAT_U16_BE, 16, 2, 0, 0, 1),
-   FMT(SND_PCM_FORMAT_S24_3LE, 24, 3, 1, 1, 1),
-   FMT(SND_PCM_FORMAT_S24_3BE, 24, 3, 1, 0, 1),
-   FMT(SND_PCM_FORMAT_U24_3LE, 24, 3, 0, 1, 1),
-   FMT(SND_PCM_FORMAT_U24_3BE, 24, 3, 0, 0, 1),
-   FMT(SND_PCM_FORMAT_S32_LE, 24, 4, 1, 1, 1),
-   FMT(SND_PCM_FORMAT_S32_BE, 24, 4, 1, 0, 1),
-   FMT(SND_PCM_FORMAT_U32_LE, 24, 4, 0, 1, 1),
-   FMT(SND_PCM_FORMAT_U32_BE, 24, 4, 0, 0, 1),
-   FMT(SND_PCM_FORMAT_FLOAT_LE, 32, 4, 1, 1, 1), // always transcoded
-   FMT(SND_PCM_FORMAT_FLOAT_BE, 32, 4, 1, 0, 1) // always transcoded
+   int width, phys; // in bits, -1 if variable
+   int sig, le; // -1 if it doesn't apply
+   unsigned char silence; // silence byte of the formats that aren't linear
+   struct sio_enc enc; // how sndio takes linear formats, for the others the sample size to decode
+   enum codec codec;
+} FORMATS[SND_PCM_FORMAT_LAST + 1] = {
+#define LINEAR_FMT(F, WIDTH, PHYS, SIG, LE, BITS, MSB, DESC) \
+   [SND_PCM_FORMAT_##F] = { .name = #F, .description = DESC, .fmt = SND_PCM_FORMAT_##F, .width = WIDTH, .phys = PHYS, .sig = SIG, .le = LE, \
+      .enc = { .bits = BITS, .bps = PHYS / 8, .sig = SIG, .le = (LE != 0), .msb = MSB }, .codec = CODEC_LINEAR },
+#define FMT(F, WIDTH, PHYS, SIG, LE, SILENCE, CODEC, DESC) \
+   [SND_PCM_FORMAT_##F] = { .name = #F, .description = DESC, .fmt = SND_PCM_FORMAT_##F, .width = WIDTH, .phys = PHYS, .sig = SIG, .le = LE, .silence = SILENCE, \
+      .enc = { .bits = WIDTH, .bps = PHYS / 8, .sig = 1, .le = (LE != 0), .msb = 1 }, .codec = CODEC },
+   LINEAR_FORMATS(LINEAR_FMT)
+   // always transcoded
+   FMT(FLOAT_LE, 32, 32, -1, 1, 0, CODEC_FLOAT, "Float 32 bit Little Endian")
+   FMT(FLOAT_BE, 32, 32, -1, 0, 0, CODEC_FLOAT, "Float 32 bit Big Endian")
+   FMT(FLOAT64_LE, 64, 64, -1, 1, 0, CODEC_FLOAT64, "Float 64 bit Little Endian")
+   FMT(FLOAT64_BE, 64, 64, -1, 0, 0, CODEC_FLOAT64, "Float 64 bit Big Endian")
+   FMT(MU_LAW, 8, 8, -1, -1, 0xff, CODEC_MU_LAW, "Mu-Law")
+   FMT(A_LAW, 8, 8, -1, -1, 0xd5, CODEC_A_LAW, "A-Law")
+   // only described
+   FMT(IEC958_SUBFRAME_LE, 32, 32, -1, 1, 0, CODEC_NONE, "IEC-958 Little Endian")
+   FMT(IEC958_SUBFRAME_BE, 32, 32, -1, 0, 0, CODEC_NONE, "IEC-958 Big Endian")
+   FMT(IMA_ADPCM, 4, 4, -1, -1, 0, CODEC_NONE, "Ima-ADPCM")
+   FMT(MPEG, -1, -1, -1, -1, 0, CODEC_NONE, "MPEG")
+   FMT(GSM, -1, -1, -1, -1, 0, CODEC_NONE, "GSM")
+   FMT(SPECIAL, -1, -1, -1, -1, 0, CODEC_NONE, "Special")
+   FMT(G723_24, 3, 3, -1, -1, 0, CODEC_NONE, "G.723 (ADPCM) 24 kbit/s, 8 samples in 3 bytes")
+   FMT(G723_24_1B, 3, 8, -1, -1, 0, CODEC_NONE, "G.723 (ADPCM) 24 kbit/s, 1 sample in 1 byte")
+   FMT(G723_40, 5, 5, -1, -1, 0, CODEC_NONE, "G.723 (ADPCM) 40 kbit/s, 8 samples in 3 bytes")
+   FMT(G723_40_1B, 5, 8, -1, -1, 0, CODEC_NONE, "G.723 (ADPCM) 40 kbit/s, 1 sample in 1 byte")
+   FMT(DSD_U8, 8, 8, 0, -1, 0x69, CODEC_NONE, "Direct Stream Digital, 1-byte (x8), oldest bit in MSB")
+   FMT(DSD_U16_LE, 16, 16, 0, 1, 0x69, CODEC_NONE, "Direct Stream Digital, 2-byte (x16), little endian, oldest bits in MSB")
+   FMT(DSD_U32_LE, 32, 32, 0, 1, 0x69, CODEC_NONE, "Direct Stream Digital, 4-byte (x32), little endian, oldest bits in MSB")
+   FMT(DSD_U16_BE, 16, 16, 0, 0, 0x69, CODEC_NONE, "Direct Stream Digital, 2-byte (x16), big endian, oldest bits in MSB")
+   FMT(DSD_U32_BE, 32, 32, 0, 0, 0x69, CODEC_NONE, "Direct Stream Digital, 4-byte (x32), big endian, oldest bits in MSB")
 #undef FMT
+#undef LINEAR_FMT
+};
+
+// sndio encodings are small enough to index with directly, entries are the format + 1
+#define ENC_KEY(BITS, BPS, SIG, LE, MSB) (((((BPS) - 1) * 32 + (BITS) - 1) * 2 + (SIG)) * 4 + (LE) * 2 + (MSB))
+static const unsigned char FORMAT_FOR_ENC[ENC_KEY(32, 4, 1, 1, 1) + 1] = {
+#define LINEAR_ENC(F, WIDTH, PHYS, SIG, LE, BITS, MSB, DESC) [ENC_KEY(BITS, PHYS / 8, SIG, (LE != 0), MSB)] = SND_PCM_FORMAT_##F + 1,
+   LINEAR_FORMATS(LINEAR_ENC)
+#undef LINEAR_ENC
+};
+#undef ENC_KEY
+
+// names and native endian aliases, placed by format_name_hash which is perfect over them
+// (h = h * 1750 + c over the upper cased name, modulo the table size)
+static const struct {
+   const char *name;
+   snd_pcm_format_t fmt;
+} FORMAT_FOR_NAME[179] = {
+   [3] = { "S24", SND_PCM_FORMAT_S24 },
+   [11] = { "S20_BE", SND_PCM_FORMAT_S20_BE },
+   [12] = { "IEC958_SUBFRAME_LE", SND_PCM_FORMAT_IEC958_SUBFRAME_LE },
+   [17] = { "U20_BE", SND_PCM_FORMAT_U20_BE },
+   [23] = { "U16", SND_PCM_FORMAT_U16 },
+   [25] = { "S24_LE", SND_PCM_FORMAT_S24_LE },
+   [26] = { "U20_3LE", SND_PCM_FORMAT_U20_3LE },
+   [27] = { "FLOAT64_LE", SND_PCM_FORMAT_FLOAT64_LE },
+   [31] = { "U24_LE", SND_PCM_FORMAT_U24_LE },
+   [34] = { "U24_3LE", SND_PCM_FORMAT_U24_3LE },
+   [36] = { "S32_BE", SND_PCM_FORMAT_S32_BE },
+   [38] = { "IMA_ADPCM", SND_PCM_FORMAT_IMA_ADPCM },
+   [40] = { "MU_LAW", SND_PCM_FORMAT_MU_LAW },
+   [45] = { "S16", SND_PCM_FORMAT_S16 },
+   [48] = { "G723_24_1B", SND_PCM_FORMAT_G723_24_1B },
+   [54] = { "IEC958_SUBFRAME_BE", SND_PCM_FORMAT_IEC958_SUBFRAME_BE },
+   [55] = { "DSD_U16_LE", SND_PCM_FORMAT_DSD_U16_LE },
+   [56] = { "S20_3LE", SND_PCM_FORMAT_S20_3LE },
+   [57] = { "U8", SND_PCM_FORMAT_U8 },
+   [58] = { "FLOAT_LE", SND_PCM_FORMAT_FLOAT_LE },
+   [59] = { "G723_40_1B", SND_PCM_FORMAT_G723_40_1B },
+   [64] = { "S24_3LE", SND_PCM_FORMAT_S24_3LE },
+   [66] = { "DSD_U32_LE", SND_PCM_FORMAT_DSD_U32_LE },
+   [67] = { "S24_BE", SND_PCM_FORMAT_S24_BE },
+   [68] = { "U20_3BE", SND_PCM_FORMAT_U20_3BE },
+   [69] = { "FLOAT64_BE", SND_PCM_FORMAT_FLOAT64_BE },
+   [71] = { "DSD_U8", SND_PCM_FORMAT_DSD_U8 },
+   [72] = { "G723_24", SND_PCM_FORMAT_G723_24 },
+   [73] = { "U24_BE", SND_PCM_FORMAT_U24_BE },
+   [76] = { "U24_3BE", SND_PCM_FORMAT_U24_3BE },
+   [93] = { "GSM", SND_PCM_FORMAT_GSM },
+   [94] = { "IEC958_SUBFRAME", SND_PCM_FORMAT_IEC958_SUBFRAME },
+   [95] = { "FLOAT64", SND_PCM_FORMAT_FLOAT64 },
+   [97] = { "DSD_U16_BE", SND_PCM_FORMAT_DSD_U16_BE },
+   [98] = { "S20_3BE", SND_PCM_FORMAT_S20_3BE },
+   [99] = { "SPECIAL", SND_PCM_FORMAT_SPECIAL },
+   [100] = { "FLOAT_BE", SND_PCM_FORMAT_FLOAT_BE },
+   [102] = { "U18_3LE", SND_PCM_FORMAT_U18_3LE },
+   [106] = { "S24_3BE", SND_PCM_FORMAT_S24_3BE },
+   [108] = { "DSD_U32_BE", SND_PCM_FORMAT_DSD_U32_BE },
+   [109] = { "S16_LE", SND_PCM_FORMAT_S16_LE },
+   [110] = { "A_LAW", SND_PCM_FORMAT_A_LAW },
+   [115] = { "U16_LE", SND_PCM_FORMAT_U16_LE },
+   [118] = { "U32", SND_PCM_FORMAT_U32 },
+   [126] = { "U32_LE", SND_PCM_FORMAT_U32_LE },
+   [132] = { "S18_3LE", SND_PCM_FORMAT_S18_3LE },
+   [136] = { "MPEG", SND_PCM_FORMAT_MPEG },
+   [137] = { "S8", SND_PCM_FORMAT_S8 },
+   [140] = { "S32", SND_PCM_FORMAT_S32 },
+   [144] = { "U18_3BE", SND_PCM_FORMAT_U18_3BE },
+   [148] = { "S20_LE", SND_PCM_FORMAT_S20_LE },
+   [151] = { "S16_BE", SND_PCM_FORMAT_S16_BE },
+   [154] = { "U20_LE", SND_PCM_FORMAT_U20_LE },
+   [156] = { "U20", SND_PCM_FORMAT_U20 },
+   [157] = { "U16_BE", SND_PCM_FORMAT_U16_BE },
+   [160] = { "U24", SND_PCM_FORMAT_U24 },
+   [167] = { "G723_40", SND_PCM_FORMAT_G723_40 },
+   [168] = { "U32_BE", SND_PCM_FORMAT_U32_BE },
+   [173] = { "S32_LE", SND_PCM_FORMAT_S32_LE },
+   [174] = { "S18_3BE", SND_PCM_FORMAT_S18_3BE },
+   [176] = { "FLOAT", SND_PCM_FORMAT_FLOAT },
+   [178] = { "S20", SND_PCM_FORMAT_S20 },
 };
 
+static unsigned int
+format_name_hash(const char *name)
+{
+   uint32_t h = 0;
+   for (; *name; ++name)
+      h = h * 1750 + toupper((unsigned char)*name);
+   return h % ARRAY_SIZE(FORMAT_FOR_NAME);
+}
+
+static const struct format_info*
+format_info_any(const snd_pcm_format_t format)
+{
+   if ((unsigned int)format >= ARRAY_SIZE(FORMATS) || !FORMATS[format].name)
+      return NULL;
+   return &FORMATS[format];
+}
+
 const struct format_info*
 format_info_for_sio_enc(const struct sio_enc *enc)
 {
-   for (size_t i = 0; i < ARRAY_SIZE(SUPPORTED_FORMATS); ++i) {
-      if (!memcmp(enc, &SUPPORTED_FORMATS[i].enc, sizeof(*enc)))
-         return &SUPPORTED_FORMATS[i];
-   }
-   return NULL;
+   if (enc->bits < 1 || enc->bits > 32 || enc->bps < 1 || enc->bps > 4 || enc->sig > 1 || enc->le > 1 || enc->msb > 1)
+      return NULL;
+
+   const unsigned int i = FORMAT_FOR_ENC[(((enc->bps - 1) * 32 + enc->bits - 1) * 2 + enc->sig) * 4 + enc->le * 2 + enc->msb];
+   return (i ? &FORMATS[i - 1] : NULL);
 }
 
 const struct format_info*
@@ -59,22 +223,24 @@ format_info_for_sio_par(const struct sio_par *par)
    return format_info_for_sio_enc(&enc);;
 }
 
+// only the formats that can be played or recorded
 const struct format_info*
 format_info_for_format(const snd_pcm_format_t format)
 {
-   for (size_t i = 0; i < ARRAY_SIZE(SUPPORTED_FORMATS); ++i) {
-      if (SUPPORTED_FORMATS[i].fmt == format)
-         return &SUPPORTED_FORMATS[i];
-   }
-   return NULL;
+   const struct format_info *info = format_info_any(format);
+   return (info && info->codec != CODEC_NONE ? info : NULL);
 }
 
 snd_pcm_format_t
 snd_pcm_format_value(const char* name)
 {
-   for (size_t i = 0; i < ARRAY_SIZE(SUPPORTED_FORMATS); ++i) {
-      if (!strcmp(SUPPORTED_FORMATS[i].name, name))
-         return SUPPORTED_FORMATS[i].fmt;
+   const unsigned int i = format_name_hash(name);
+   if (FORMAT_FOR_NAME[i].name && !strcasecmp(FORMAT_FOR_NAME[i].name, name))
+      return FORMAT_FOR_NAME[i].fmt;
+
+   for (size_t f = 0; f < ARRAY_SIZE(FORMATS); ++f) {
+      if (FORMATS[f].description && !strcasecmp(FORMATS[f].description, name))
+         return FORMATS[f].fmt;
    }
    return SND_PCM_FORMAT_UNKNOWN;
 }
@@ -82,67 +248,409 @@ snd_pcm_format_value(const char* name)
 const char*
 snd_pcm_format_name(const snd_pcm_format_t format)
 {
-   const struct format_info *info = format_info_for_format(format);
+   const struct format_info *info = format_info_any(format);
    return (info ? info->name : NULL);
 }
 
 const char*
 snd_pcm_format_description(const snd_pcm_format_t format)
 {
-   return snd_pcm_format_name(format);
+   const struct format_info *info = format_info_any(format);
+   return (info ? info->description : NULL);
 }
 
 int
 snd_pcm_format_width(snd_pcm_format_t format)
 {
-   const struct format_info *info = format_info_for_format(format);
-   return (info ? (int)info->enc.bits : -1);
+   const struct format_info *info = format_info_any(format);
+   return (info && info->width > 0 ? info->width : -EINVAL);
 }
 
 int
 snd_pcm_format_physical_width(snd_pcm_format_t format)
 {
-   const struct format_info *info = format_info_for_format(format);
-   return (info ? (int)info->enc.bps * 8 : -1);
+   const struct format_info *info = format_info_any(format);
+   return (info && info->phys > 0 ? info->phys : -EINVAL);
 }
 
 ssize_t
 snd_pcm_format_size(snd_pcm_format_t format, size_t samples)
 {
-   return samples * snd_pcm_format_physical_width(format) / 8;
+   const int phys = snd_pcm_format_physical_width(format);
+   return (phys > 0 ? (ssize_t)(samples * phys / 8) : -EINVAL);
+}
+
+int
+snd_pcm_format_signed(snd_pcm_format_t format)
+{
+   const struct format_info *info = format_info_any(format);
+   return (info && info->sig >= 0 ? info->sig : -EINVAL);
+}
+
+int
+snd_pcm_format_unsigned(snd_pcm_format_t format)
+{
+   const int sig = snd_pcm_format_signed(format);
+   return (sig < 0 ? sig : !sig);
+}
+
+int
+snd_pcm_format_linear(snd_pcm_format_t format)
+{
+   return snd_pcm_format_signed(format) >= 0;
+}
+
+int
+snd_pcm_format_float(snd_pcm_format_t format)
+{
+   const struct format_info *info = format_info_any(format);
+   return (info && (info->codec == CODEC_FLOAT || info->codec == CODEC_FLOAT64));
+}
+
+int
+snd_pcm_format_little_endian(snd_pcm_format_t format)
+{
+   const struct format_info *info = format_info_any(format);
+   return (info && info->le >= 0 ? info->le : -EINVAL);
+}
+
+int
+snd_pcm_format_big_endian(snd_pcm_format_t format)
+{
+   const int le = snd_pcm_format_little_endian(format);
+   return (le < 0 ? le : !le);
+}
+
+int
+snd_pcm_format_cpu_endian(snd_pcm_format_t format)
+{
+   return (SIO_LE_NATIVE ? snd_pcm_format_little_endian(format) : snd_pcm_format_big_endian(format));
+}
+
+snd_pcm_format_t
+snd_pcm_build_linear_format(int width, int pwidth, int unsignd, int big_endian)
+{
+   // like alsa only the 3 byte formats are picked by pwidth, the rest by width
+   if (pwidth != 24)
+      pwidth = (width <= 16 ? width : 32);
+
+   for (size_t f = 0; f < ARRAY_SIZE(FORMATS); ++f) {
+      const struct format_info *info = &FORMATS[f];
+      if (info->codec == CODEC_LINEAR && info->width == width && info->phys == pwidth &&
+          info->sig == !unsignd && (info->le < 0 || info->le == !big_endian))
+         return info->fmt;
+   }
+   return SND_PCM_FORMAT_UNKNOWN;
+}
+
+uint64_t
+snd_pcm_format_silence_64(snd_pcm_format_t format)
+{
+   const struct format_info *info = format_info_any(format);
+   if (!info || info->phys <= 0)
+      return 0;
+
+   // one sample's bytes repeated over 64 bits, in memory order
+   unsigned char sample[8] = {0}, bytes[8];
+   const unsigned int bps = MAX(info->phys / 8, 1);
+   if (info->codec == CODEC_LINEAR && !info->sig) {
+      const uint32_t v = (uint32_t)1 << (info->width - 1);
+      for (unsigned int i = 0; i < bps; ++i)
+         sample[i] = v >> (8 * (info->le > 0 ? i : bps - 1 - i));
+   } else {
+      memset(sample, info->silence, sizeof(sample));
+   }
+
+   for (unsigned int i = 0; i < sizeof(bytes); ++i)
+      bytes[i] = sample[i % bps];
+
+   uint64_t silence;
+   memcpy(&silence, bytes, sizeof(silence));
+   return silence;
+}
+
+uint32_t
+snd_pcm_format_silence_32(snd_pcm_format_t format)
+{
+   return (uint32_t)snd_pcm_format_silence_64(format);
+}
+
+uint16_t
+snd_pcm_format_silence_16(snd_pcm_format_t format)
+{
+   return (uint16_t)snd_pcm_format_silence_64(format);
+}
+
+uint8_t
+snd_pcm_format_silence(snd_pcm_format_t format)
+{
+   return (uint8_t)snd_pcm_format_silence_64(format);
+}
+
+int
+snd_pcm_format_set_silence(snd_pcm_format_t format, void *buf, unsigned int samples)
+{
+   const int phys = snd_pcm_format_physical_width(format);
+   if (phys < 0)
+      return -EINVAL;
+
+   const uint64_t silence = snd_pcm_format_silence_64(format);
+   const size_t bytes = (size_t)samples * phys / 8;
+   unsigned char pattern[sizeof(silence)];
+   memcpy(pattern, &silence, sizeof(pattern));
+
+   // signed formats and most of the rest repeat a single byte, packed sub-byte formats are all zero
+   if (phys % 8 || !memcmp(pattern, pattern + 1, sizeof(pattern) - 1)) {
+      memset(buf, pattern[0], bytes);
+      return 0;
+   }
+
+   // otherwise one sample is doubled until the buffer is full so the bulk of it is memcpy
+   size_t done = MIN((size_t)phys / 8, bytes);
+   memcpy(buf, pattern, done);
+   while (done < bytes) {
+      const size_t n = MIN(done, bytes - done);
+      memcpy((unsigned char*)buf + done, buf, n);
+      done += n;
+   }
+   return 0;
+}
+
+static unsigned char*
+area_addr(const snd_pcm_channel_area_t *area, snd_pcm_uframes_t offset)
+{
+   return (unsigned char*)area->addr + (area->first + offset * area->step) / 8;
+}
+
+// same buffer with the channels one after another, so the frames are a single run of samples
+static bool
+areas_interleaved(const snd_pcm_channel_area_t *areas, unsigned int channels, int phys)
+{
+   for (unsigned int c = 0; c < channels; ++c) {
+      if (areas[c].addr != areas[0].addr || areas[c].first != areas[0].first + c * phys || areas[c].step != channels * phys)
+         return false;
+   }
+   return true;
+}
+
+// samples that are not packed need to start and step at byte boundaries
+static bool
+area_bytewise(const snd_pcm_channel_area_t *area, int phys)
+{
+   return !(phys % 8) && !(area->first % 8) && !(area->step % 8);
+}
+
+// the fixed sizes let the compiler turn the memcpy into a plain load and store
+#define STRIDED_COPY(BPS) for (; samples > 0; --samples, dst += dst_step, src += src_step) memcpy(dst, src, BPS)
+
+static void
+strided_copy(unsigned char *dst, size_t dst_step, const unsigned char *src, size_t src_step, size_t bps, unsigned int samples)
+{
+   switch (bps) {
+      case 1: STRIDED_COPY(1); break;
+      case 2: STRIDED_COPY(2); break;
+      case 3: STRIDED_COPY(3); break;
+      case 4: STRIDED_COPY(4); break;
+      case 8: STRIDED_COPY(8); break;
+      default: STRIDED_COPY(bps); break;
+   }
+}
+
+#undef STRIDED_COPY
+
+int
+snd_pcm_area_silence(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes_t dst_offset, unsigned int samples, snd_pcm_format_t format)
+{
+   const int phys = snd_pcm_format_physical_width(format);
+   if (phys < 0)
+      return -EINVAL;
+
+   if (!dst_area->addr)
+      return 0;
+
+   unsigned char *dst = area_addr(dst_area, dst_offset);
+   if (dst_area->step == (unsigned int)phys)
+      return snd_pcm_format_set_silence(format, dst, samples);
+
+   if (!area_bytewise(dst_area, phys))
+      return -EINVAL;
+
+   // the pattern is read from the same place for every sample
+   const uint64_t silence = snd_pcm_format_silence_64(format);
+   strided_copy(dst, dst_area->step / 8, (const unsigned char*)&silence, 0, phys / 8, samples);
+   return 0;
+}
+
+int
+snd_pcm_areas_silence(const snd_pcm_channel_area_t *dst_channels, snd_pcm_uframes_t dst_offset, unsigned int channels, snd_pcm_uframes_t frames, snd_pcm_format_t format)
+{
+   const int phys = snd_pcm_format_physical_width(format);
+   if (phys < 0)
+      return -EINVAL;
+
+   if (channels > 0 && dst_channels[0].addr && areas_interleaved(dst_channels, channels, phys))
+      return snd_pcm_format_set_silence(format, area_addr(&dst_channels[0], dst_offset), frames * channels);
+
+   for (unsigned int c = 0; c < channels; ++c) {
+      int err;
+      if ((err = snd_pcm_area_silence(&dst_channels[c], dst_offset, frames, format)) < 0)
+         return err;
+   }
+   return 0;
+}
+
+int
+snd_pcm_area_copy(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes_t dst_offset, const snd_pcm_channel_area_t *src_area, snd_pcm_uframes_t src_offset, unsigned int samples, snd_pcm_format_t format)
+{
+   const int phys = snd_pcm_format_physical_width(format);
+   if (phys < 0)
+      return -EINVAL;
+
+   if (!dst_area->addr)
+      return 0;
+
+   // like alsa a source without a buffer reads as silence
+   if (!src_area->addr)
+      return snd_pcm_area_silence(dst_area, dst_offset, samples, format);
+
+   unsigned char *dst = area_addr(dst_area, dst_offset);
+   const unsigned char *src = area_addr(src_area, src_offset);
+   if (dst == src && dst_area->step == src_area->step)
+      return 0;
+
+   if (dst_area->step == (unsigned int)phys && src_area->step == (unsigned int)phys) {
+      memcpy(dst, src, (size_t)samples * phys / 8);
+      return 0;
+   }
+
+   if (!area_bytewise(dst_area, phys) || !area_bytewise(src_area, phys))
+      return -EINVAL;
+
+   strided_copy(dst, dst_area->step / 8, src, src_area->step / 8, phys / 8, samples);
+   return 0;
+}
+
+int
+snd_pcm_areas_copy(const snd_pcm_channel_area_t *dst_channels, snd_pcm_uframes_t dst_offset, const snd_pcm_channel_area_t *src_channels, snd_pcm_uframes_t src_offset, unsigned int channels, snd_pcm_uframes_t frames, snd_pcm_format_t format)
+{
+   const int phys = snd_pcm_format_physical_width(format);
+   if (phys < 0)
+      return -EINVAL;
+
+   // interleaved on both sides the frames are copied whole
+   if (channels > 0 && dst_channels[0].addr && src_channels[0].addr &&
+       areas_interleaved(dst_channels, channels, phys) && areas_interleaved(src_channels, channels, phys)) {
+      unsigned char *dst = area_addr(&dst_channels[0], dst_offset);
+      const unsigned char *src = area_addr(&src_channels[0], src_offset);
+      if (dst != src)
+         memcpy(dst, src, (size_t)frames * channels * phys / 8);
+      return 0;
+   }
+
+   for (unsigned int c = 0; c < channels; ++c) {
+      int err;
+      if ((err = snd_pcm_area_copy(&dst_channels[c], dst_offset, &src_channels[c], src_offset, frames, format)) < 0)
+         return err;
+   }
+   return 0;
+}
+
+int
+snd_pcm_areas_copy_wrap(const snd_pcm_channel_area_t *dst_channels, snd_pcm_uframes_t dst_offset, const snd_pcm_uframes_t dst_size, const snd_pcm_channel_area_t *src_channels, snd_pcm_uframes_t src_offset, const snd_pcm_uframes_t src_size, const unsigned int channels, snd_pcm_uframes_t frames, const snd_pcm_format_t format)
+{
+   while (frames > 0) {
+      // neither side is read or written past its end
+      const snd_pcm_uframes_t todo = MIN(MIN(frames, dst_size - dst_offset), src_size - src_offset);
+
+      int err;
+      if ((err = snd_pcm_areas_copy(dst_channels, dst_offset, src_channels, src_offset, channels, todo, format)) < 0)
+         return err;
+
+      dst_offset = (dst_offset + todo) % dst_size;
+      src_offset = (src_offset + todo) % src_size;
+      frames -= todo;
+   }
+   return 0;
 }
 
 struct _snd_pcm_hw_params {
    struct sio_cap cap;
    struct sio_par par;
    struct hw_limits {
-      snd_pcm_format_t supported[ARRAY_SIZE(SUPPORTED_FORMATS)];
+      snd_pcm_format_t supported[SND_PCM_FORMAT_LAST + 1];
       unsigned int pchan[2], rchan[2], rate[2];
+      uint64_t block_ns; // duration of the device block, sndiod only does rounds of whole blocks
    } limits;
    int period_time;
    snd_pcm_format_t format;
    snd_pcm_access_t access;
    snd_pcm_stream_t stream;
    bool needs_conversion; // for unsupported formats
+   bool rate_resample; // any rate goes and sndiod converts, otherwise only the rates the device reports
 };
 
 struct _snd_pcm_sw_params {
    snd_pcm_uframes_t avail_min;
+   snd_pcm_uframes_t start_threshold, stop_threshold;
+   snd_pcm_uframes_t silence_threshold, silence_size;
+   snd_pcm_tstamp_t tstamp_mode;
+   snd_pcm_tstamp_type_t tstamp_type;
+};
+
+#define SW_BOUNDARY ((snd_pcm_uframes_t)LONG_MAX)
+
+struct drift {
+   double time; // filtered CLOCK_MONOTONIC ns of the last position update
+   double period; // estimated ns per frame
+   unsigned int updates;
+};
+
+struct adapt {
+   snd_pcm_uframes_t min, max; // bounds of the effective buffer, max 0 when off
+   snd_pcm_uframes_t size; // effective buffer, what avail is limited to
+   snd_pcm_uframes_t low; // lowest fill seen at a position update since window
+   uint64_t window; // CLOCK_MONOTONIC ns the current stable window started
+};
+
+struct queue {
+   unsigned char *data;
+   snd_pcm_uframes_t size, head, len; // in frames, head is the oldest queued frame
+   uint64_t time; // CLOCK_MONOTONIC ns when the queue last became non-empty
 };
 
 struct _snd_pcm {
    struct _snd_pcm_hw_params hw;
    struct _snd_pcm_sw_params sw;
-   struct timespec start_time;
+   uint64_t trigger_time, move_time; // CLOCK_MONOTONIC ns of sio_start and last onmove
+   struct drift drift;
+   struct adapt adapt;
    struct {
-      snd_pcm_channel_area_t areas[NCHAN_MAX];
+      snd_pcm_channel_area_t *areas; // one per channel, sized by hw_params
       unsigned char *data;
    } mmap;
+   struct queue queue; // app format frames not yet handed to sio_write, or read ahead from sio_read
+   struct sio_par dev; // what the device runs with, hw.par may emulate a smaller buffer or longer period on top
    struct sio_hdl *hdl;
+   struct sio_hdl *spare; // negotiated on the side while the stream runs, swapped in by snd_pcm_hw_params
+   struct sio_hdl *retired; // the handle swapped out, still playing what it has until retire_time
+   uint64_t retire_time;
+   snd_pcm_t *link; // the other direction of a snd_pcm_link pair, sharing hdl
+   struct direct *direct; // mixed (dmix) or shared (dsnoop) in process on one hdl, see direct_join
+   snd_pcm_t *direct_next;
+   snd_pcm_uframes_t direct_base; // frame of the shared stream our first frame is mixed into or recorded at
+   struct multi *multi; // more devices playing the rest of the channels of each frame, see multi_open
+   struct {
+      unsigned char src[CMAT_NCHAN_MAX]; // channel of the decoded frame each converted channel is taken from
+      unsigned int channels; // the map only applies while the pcm still has this many channels
+   } chmap; // the app's channel order where it differs from the device's, see snd_pcm_set_chmap
    const char *name;
-   snd_pcm_uframes_t position, written, avail;
+   snd_pcm_uframes_t position, written, avail, avail_max;
+   snd_pcm_uframes_t sent; // frames handed to (or read from) sndio, the difference to written is in the queue
+   snd_pcm_uframes_t rewind_window; // newest queued frames held back from sndio for snd_pcm_rewind
+   unsigned long xruns;
    int mode;
-   bool started;
+   snd_pcm_state_t state;
+   bool started; // sio_start has been called
 };
 
 static int
@@ -166,628 +674,3044 @@ sndio_mode(int mode)
    return false;
 }
 
-static void
-onmove(void *arg, int delta)
+static uint64_t
+get_time_ns(void)
 {
-   snd_pcm_t *pcm = arg;
-   pcm->position += delta;
-   pcm->avail += delta;
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * (uint64_t)1e9 + (uint64_t)ts.tv_nsec;
 }
 
-static struct sio_hdl*
-device_open(snd_pcm_t *pcm, const char *name, snd_pcm_stream_t stream, int mode)
+#define DRIFT_SETTLE_UPDATES 64
+
+static void
+drift_reset(snd_pcm_t *pcm)
 {
-   const char *sndio_name = (!name || !strcmp(name, "default") ? SIO_DEVANY : name);
+   pcm->drift = (struct drift){ .period = (pcm->hw.par.rate ? 1e9 / pcm->hw.par.rate : 0) };
+}
 
-   struct sio_hdl *hdl;
-   if (!(hdl = sio_open(sndio_name, sndio_stream(stream), sndio_mode(mode))) &&
-       !(hdl = sio_open(SIO_DEVANY, sndio_stream(stream), sndio_mode(mode)))) {
-      WARNX1("sio_open failed");
-      return NULL;
+static void
+drift_update(snd_pcm_t *pcm, const uint64_t now, const int delta)
+{
+   // second order delay-locked loop over the onmove timestamps. onmoves are only observed when the
+   // app calls into sndio, so the observations are noisy and late, the loop filters that out.
+   struct drift *d = &pcm->drift;
+   if (delta <= 0 || !pcm->hw.par.rate)
+      return;
+
+   const double nominal = 1e9 / pcm->hw.par.rate;
+   const double expected = d->time + d->period * delta;
+   const double err = (double)now - expected;
+   const double bound = nominal * MAX((unsigned int)delta, pcm->hw.par.round) * 2;
+
+   if (!d->updates || d->time <= 0 || err > bound || err < -bound) {
+      // first update or a discontinuity (xrun, app not polling), restart the phase but keep the rate
+      d->time = now;
+      d->updates = (d->updates ? d->updates : 1);
+      return;
    }
 
-   pcm->mode = mode;
-   pcm->hw.stream = stream;
-   sio_onmove(hdl, onmove, pcm);
-   return hdl;
+   // wide bandwidth until locked, then narrow to reject scheduling jitter
+   const double bw = (d->updates < DRIFT_SETTLE_UPDATES ? 1.0 : 0.05);
+   const double omega = 2 * 3.14159265358979 * bw * (delta * nominal / 1e9);
+   d->time = expected + 1.41421356237310 * omega * err;
+   d->period += (omega * omega * err) / delta;
+   d->period = MIN(MAX(d->period, nominal * 0.9), nominal * 1.1);
+
+   if (!(++d->updates % 1024))
+      WARNX("%s clock ratio: %.6f", (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? "playback" : "capture"), nominal / d->period);
 }
 
+#define ADAPT_WINDOW_NS ((uint64_t)5e9)
+
 static void
-dump_enc(const struct sio_enc *enc, struct hw_limits *limits)
+adapt_reset_window(snd_pcm_t *pcm, const uint64_t now)
 {
-   WARNX("- - - bits: %u bps: %u sig: %u le: %u msb: %u", enc->bits, enc->bps, enc->sig, enc->le, enc->msb);
-   const struct format_info *info = format_info_for_sio_enc(enc);
-   assert(info);
-   WARNX("- - - aka %s", info->name);
+   pcm->adapt.low = ~(snd_pcm_uframes_t)0;
+   pcm->adapt.window = now;
+}
 
-   size_t i;
-   for (i = 0; i < ARRAY_SIZE(limits->supported) && limits->supported[i] != SND_PCM_FORMAT_UNKNOWN; ++i);
-   assert(i < ARRAY_SIZE(limits->supported));
-   limits->supported[i] = info->fmt;
+static void
+adapt_grow(snd_pcm_t *pcm, const uint64_t now)
+{
+   // underran, back off fast: half again as much, at least a block
+   struct adapt *a = &pcm->adapt;
+   if (!a->max)
+      return;
+
+   const snd_pcm_uframes_t round = pcm->hw.par.round;
+   const snd_pcm_uframes_t size = ((a->size + MAX(a->size / 2, round) + round - 1) / round) * round;
+   a->size = MIN(size, a->max);
+   adapt_reset_window(pcm, now);
+   WARNX("effective buffer: %lu", a->size);
 }
 
 static void
-dump_cap(const char *name, const struct sio_cap *cap, struct hw_limits *limits)
+adapt_update(snd_pcm_t *pcm, const uint64_t now)
 {
-   *limits = (struct hw_limits){0};
-   limits->rate[0] = limits->rchan[0] = limits->pchan[0] = ~(unsigned int)0;
-   memset(limits->supported, SND_PCM_FORMAT_UNKNOWN, sizeof(limits->supported));
+   // shrink a block at a time, only after a whole window where the device never got below the
+   // margin it needs between two position updates
+   struct adapt *a = &pcm->adapt;
+   if (!a->max || pcm->state != SND_PCM_STATE_RUNNING)
+      return;
+
+   a->low = MIN(a->low, pcm->sent + pcm->queue.len - pcm->position);
+   if (now - a->window < ADAPT_WINDOW_NS)
+      return;
+
+   const snd_pcm_uframes_t round = pcm->hw.par.round;
+   if (a->low >= 2 * round && a->size > a->min) {
+      a->size = MAX(a->size - MIN(a->size, round), a->min);
+      WARNX("effective buffer: %lu", a->size);
+   }
 
-   WARNX("* %s", name);
-   for (unsigned int c = 0; c < cap->nconf; ++c) {
-      WARNX("- - configuration %u", c);
+   adapt_reset_window(pcm, now);
+}
 
-      for (unsigned int i = 0; i < SIO_NENC; ++i) {
-         if (cap->confs[c].enc & (1 << i))
-            dump_enc(&cap->enc[i], limits);
-      }
+static void
+check_xrun(snd_pcm_t *pcm, const uint64_t now)
+{
+   if (pcm->state != SND_PCM_STATE_RUNNING)
+      return;
+
+   // sndio pauses on underrun/overrun (SIO_IGNORE), so the stop is only visible as an app side state.
+   // onmoves only arrive when the app calls into sndio, so also extrapolate from the last one by time.
+   // anything within a block of it could still be onmove granularity.
+   snd_pcm_uframes_t late = 0;
+   if (pcm->move_time && now > pcm->move_time)
+      late = ((now - pcm->move_time) * pcm->hw.par.rate) / (uint64_t)1e9;
+   late -= MIN(late, pcm->hw.par.round);
+
+   // for playback the frames still in the device count, not the avail clamped to appbufsz
+   snd_pcm_uframes_t avail = pcm->avail + late;
+   if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK) {
+      const snd_pcm_uframes_t buffered = pcm->hw.par.bufsz - pcm->avail;
+      avail = pcm->hw.par.appbufsz - MIN(buffered - MIN(late, buffered), pcm->hw.par.appbufsz);
+   }
 
-      for (unsigned int i = 0; i < SIO_NCHAN; ++i) {
-         if (!(cap->confs[c].rchan & (1 << i)))
-            continue;
+   if (avail >= pcm->sw.stop_threshold) {
+      pcm->state = SND_PCM_STATE_XRUN;
+      pcm->xruns++;
+      WARNX("%s #%lu: avail %lu >= stop_threshold %lu", (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? "underrun" : "overrun"), pcm->xruns, avail, pcm->sw.stop_threshold);
+      adapt_grow(pcm, now);
+   }
+}
 
-         WARNX("- - - rchan: %u", cap->rchan[i]);
-         limits->rchan[0] = MIN(limits->rchan[0], cap->rchan[i]);
-         limits->rchan[1] = MAX(limits->rchan[1], cap->rchan[i]);
-      }
+static void
+onmove(void *arg, int delta)
+{
+   snd_pcm_t *pcm = arg;
+   pcm->move_time = get_time_ns();
+   drift_update(pcm, pcm->move_time, delta);
+   pcm->position += delta;
+   pcm->avail += delta;
+   pcm->avail_max = MAX(pcm->avail_max, pcm->avail);
+   check_xrun(pcm, pcm->move_time);
+   adapt_update(pcm, pcm->move_time);
+}
 
-      for (unsigned int i = 0; i < SIO_NCHAN; ++i) {
-         if (!(cap->confs[c].pchan & (1 << i)))
-            continue;
+static void
+onmove_linked(void *arg, int delta)
+{
+   // one sndio stream, one clock: both directions move by the same amount at the same time
+   snd_pcm_t *pcm = arg;
+   onmove(pcm, delta);
+   if (pcm->link)
+      onmove(pcm->link, delta);
+}
 
-         WARNX("- - - pchan: %u", cap->pchan[i]);
-         limits->pchan[0] = MIN(limits->pchan[0], cap->pchan[i]);
-         limits->pchan[1] = MAX(limits->pchan[1], cap->pchan[i]);
-      }
+static snd_pcm_uframes_t
+interpolated_position(const snd_pcm_t *pcm, const uint64_t now)
+{
+   // sndio only reports the position in par.round sized steps, so extrapolate from the time of the
+   // last step using the nominal rate. never go beyond the next step or what the device actually has.
+   if (!pcm->move_time || now <= pcm->move_time)
+      return pcm->position;
 
-      for (unsigned int i = 0; i < SIO_NRATE; ++i) {
-         if (!(cap->confs[c].rate & (1 << i)))
-            continue;
+   snd_pcm_uframes_t frames = MIN(((now - pcm->move_time) * pcm->hw.par.rate) / (uint64_t)1e9, pcm->hw.par.round);
+   if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK)
+      frames = MIN(frames, pcm->sent - pcm->position);
 
-         WARNX("- - - rate: %u", cap->rate[i]);
-         limits->rate[0] = MIN(limits->rate[0], cap->rate[i]);
-         limits->rate[1] = MAX(limits->rate[1], cap->rate[i]);
-      }
-   }
+   return pcm->position + frames;
 }
 
-int
-snd_pcm_open(snd_pcm_t **pcm, const char *name, snd_pcm_stream_t stream, int mode)
+static snd_pcm_sframes_t
+delay_at(const snd_pcm_t *pcm, const uint64_t now)
 {
-   if (!(*pcm = calloc(1, sizeof(**pcm)))) {
+   const snd_pcm_uframes_t position = interpolated_position(pcm, now);
+   return (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->sent + pcm->queue.len - position : position - pcm->written);
+}
+
+static snd_pcm_uframes_t
+effective_buffer(const snd_pcm_t *pcm)
+{
+   return (pcm->adapt.max ? MIN(pcm->adapt.size, pcm->hw.par.appbufsz) : pcm->hw.par.appbufsz);
+}
+
+static snd_pcm_uframes_t
+app_avail(const snd_pcm_t *pcm)
+{
+   if (pcm->hw.stream == SND_PCM_STREAM_CAPTURE)
+      return MIN(pcm->avail, pcm->hw.par.appbufsz);
+
+   // a buffer smaller than what the device negotiated is emulated by leaving the difference unused.
+   // sndio only starts once its buffer is full, so that only begins with the first onmove.
+   const snd_pcm_uframes_t reserve = (pcm->move_time ? pcm->dev.appbufsz - MIN(effective_buffer(pcm), pcm->dev.appbufsz) : 0);
+   return MIN(pcm->avail - MIN(pcm->avail, reserve), pcm->hw.par.appbufsz);
+}
+
+static snd_pcm_uframes_t
+rewind_window(const snd_pcm_t *pcm)
+{
+   // the device always keeps at least two blocks, less than that and it underruns between onmoves
+   const snd_pcm_uframes_t margin = 2 * pcm->hw.par.round;
+   if (pcm->hw.stream != SND_PCM_STREAM_PLAYBACK || pcm->hw.par.bufsz <= margin)
+      return 0;
+
+   return MIN(pcm->rewind_window, pcm->hw.par.bufsz - margin);
+}
+
+static snd_pcm_uframes_t
+held_back(const snd_pcm_t *pcm)
+{
+   // sndio only starts playing once its buffer is full, so nothing is held back before the first onmove
+   return (pcm->move_time ? rewind_window(pcm) : 0);
+}
+
+static bool
+wakes_on_moves(const snd_pcm_t *pcm)
+{
+   // the device has room the app can't use (held back frames, an emulated smaller buffer or the room
+   // is the mixer's), so POLLOUT from sndio means nothing, only the position updates do
+   return (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK && (pcm->direct || held_back(pcm) || (pcm->move_time && effective_buffer(pcm) < pcm->dev.appbufsz)));
+}
+
+static void
+ns_to_tstamp(const snd_pcm_t *pcm, const uint64_t ns, snd_htimestamp_t *ts)
+{
+   clockid_t clock;
+   switch (pcm->sw.tstamp_type) {
+      case SND_PCM_TSTAMP_TYPE_MONOTONIC: clock = CLOCK_MONOTONIC; break;
+#ifdef CLOCK_MONOTONIC_RAW
+      case SND_PCM_TSTAMP_TYPE_MONOTONIC_RAW: clock = CLOCK_MONOTONIC_RAW; break;
+#endif
+      default: clock = CLOCK_REALTIME; break;
+   }
+
+   // internally everything is CLOCK_MONOTONIC, translate to the requested clock by its current offset
+   uint64_t tns = ns;
+   if (clock != CLOCK_MONOTONIC) {
+      struct timespec now;
+      clock_gettime(clock, &now);
+      tns += ((uint64_t)now.tv_sec * (uint64_t)1e9 + (uint64_t)now.tv_nsec) - get_time_ns();
+   }
+
+   *ts = (snd_htimestamp_t){ .tv_sec = tns / (uint64_t)1e9, .tv_nsec = tns % (uint64_t)1e9 };
+}
+
+static void
+sw_params_default(snd_pcm_t *pcm)
+{
+   pcm->sw.start_threshold = 1;
+   pcm->sw.stop_threshold = pcm->hw.par.appbufsz;
+   pcm->sw.silence_threshold = pcm->sw.silence_size = 0;
+}
+
+static struct sio_hdl*
+device_connect(const char *name, unsigned int modes, int mode)
+{
+   const char *sndio_name = (!name || !strcmp(name, "default") ? SIO_DEVANY : name);
+
+   struct sio_hdl *hdl;
+   if (!(hdl = sio_open(sndio_name, modes, sndio_mode(mode))) &&
+       !(hdl = sio_open(SIO_DEVANY, modes, sndio_mode(mode)))) {
+      WARNX1("sio_open failed");
+      return NULL;
+   }
+
+   return hdl;
+}
+
+struct multi {
+   char *names; // the devices of "multi:a,b,...", NUL separated, the first one is pcm->hdl
+   unsigned int pchan; // channels of the first device, they come first in the frame
+   unsigned int nslaves;
+   struct multi_slave {
+      struct sio_hdl *hdl;
+      struct sio_par par;
+      unsigned int first; // where its channels start in the frame
+      struct resamp resamp; // absorbs the drift against the first device
+      snd_pcm_uframes_t written, played;
+      snd_pcm_uframes_t dropped; // frames that didn't fit, see snd_pcm_sndio_get_dropped
+      uint64_t move_time;
+      double err; // filtered difference of its fill to the first device's
+   } slaves[7];
+};
+
+static struct sio_hdl*
+device_open(snd_pcm_t *pcm, const char *name, snd_pcm_stream_t stream, int mode)
+{
+   // reopening an aggregate reopens its first device
+   if (pcm->multi)
+      name = pcm->multi->names;
+
+   struct sio_hdl *hdl;
+   if (!(hdl = device_connect(name, sndio_stream(stream), mode)))
+      return NULL;
+
+   pcm->mode = mode;
+   pcm->hw.stream = stream;
+   sio_onmove(hdl, onmove, pcm);
+   return hdl;
+}
+
+static bool device_setpar(struct sio_hdl *hdl, struct sio_par *par);
+static void retired_close(snd_pcm_t *pcm, const bool force);
+
+static bool
+is_adata_par(const struct sio_par *par)
+{
+   return (par->bits == ADATA_BITS && par->bps == sizeof(adata_t) && par->sig && par->le == ADATA_LE);
+}
+
+struct direct {
+   struct sio_hdl *hdl;
+   struct sio_cap cap; // sndio doesn't answer getcap/getpar once started, members get these instead
+   struct sio_par par; // what the shared stream runs with, always adata_t samples
+   snd_pcm_stream_t stream;
+   unsigned int appbufsz; // sndiod's default buffer, what members start out with
+   snd_pcm_t *members;
+   snd_pcm_uframes_t position;
+   uint64_t move_time; // CLOCK_MONOTONIC ns of the last onmove of the shared stream
+   // playback: one block, the first pending frames of it are mixed but not written yet
+   adata_t *mix;
+   snd_pcm_uframes_t sent, mixed, pending;
+   // capture: everything read from sndio, the members copy out of it at their own pace
+   adata_t *ring;
+   snd_pcm_uframes_t size, read;
+};
+
+// playback streams opened as "dmix" share one sndio stream per process, capture streams opened as "dsnoop" another
+static struct direct *direct_shared[2];
+
+static bool
+direct_wanted(const char *name, snd_pcm_stream_t stream)
+{
+   // the environment variables are for apps that only ever open "default"
+   const bool playback = (stream == SND_PCM_STREAM_PLAYBACK);
+   if (name && !strcmp(name, (playback ? "dmix" : "dsnoop")))
+      return true;
+
+   return ((!name || !strcmp(name, "default")) && getenv(playback ? "ASOUND_DMIX" : "ASOUND_DSNOOP"));
+}
+
+static unsigned int
+direct_channels(const struct direct *d)
+{
+   return (d->stream == SND_PCM_STREAM_PLAYBACK ? d->par.pchan : d->par.rchan);
+}
+
+static void
+direct_onmove(void *arg, int delta)
+{
+   // every member moves with the shared stream from where it joined, playback only over the frames it
+   // actually had in there
+   struct direct *d = arg;
+   d->position += delta;
+   d->move_time = get_time_ns();
+
+   for (snd_pcm_t *pcm = d->members; pcm; pcm = pcm->direct_next) {
+      if (!pcm->started)
+         continue;
+
+      snd_pcm_uframes_t moved = (d->position > pcm->direct_base ? d->position - pcm->direct_base : 0);
+      if (d->stream == SND_PCM_STREAM_PLAYBACK)
+         moved = MIN(moved, pcm->sent);
+
+      if (moved > pcm->position)
+         onmove(pcm, moved - pcm->position);
+   }
+}
+
+static struct direct*
+direct_open(snd_pcm_stream_t stream)
+{
+   struct direct *d;
+   if (!(d = calloc(1, sizeof(*d)))) {
       WARN1("calloc");
-      return -1;
+      return NULL;
+   }
+
+   // non-blocking, the members block in snd_pcm_wait on their own avail instead
+   d->stream = stream;
+   if (!(d->hdl = device_connect("default", sndio_stream(stream), SND_PCM_NONBLOCK)) ||
+       !sio_getcap(d->hdl, &d->cap) || !sio_getpar(d->hdl, &d->par))
+      goto fail;
+
+   // mixing and conversions are done in adata_t, so that's what the device does. the buffer stays
+   // sndiod's default, nothing mixes while no member calls in and it has to last until one does.
+   d->appbufsz = d->par.appbufsz;
+   d->par.bits = ADATA_BITS;
+   d->par.bps = sizeof(adata_t);
+   d->par.sig = 1;
+   d->par.le = ADATA_LE;
+   d->par.msb = 1;
+
+   if (!device_setpar(d->hdl, &d->par))
+      goto fail;
+
+   if (!is_adata_par(&d->par)) {
+      WARNX1("device doesn't take the mixing format");
+      goto fail;
+   }
+
+   const size_t bpf = d->par.bps * direct_channels(d);
+   if (stream == SND_PCM_STREAM_PLAYBACK ? !(d->mix = calloc(d->par.round, bpf)) : !(d->ring = calloc((d->size = d->par.appbufsz), bpf))) {
+      WARN1("calloc");
+      goto fail;
+   }
+
+   // the stream idles (SIO_IGNORE) whenever no member feeds or reads it, so it can be left running
+   sio_onmove(d->hdl, direct_onmove, d);
+   if (!sio_start(d->hdl)) {
+      WARNX1("sio_start failed");
+      goto fail;
+   }
+
+   d->move_time = get_time_ns();
+   WARNX("%s: rate: %u, round: %u, chan: %u", (stream == SND_PCM_STREAM_PLAYBACK ? "dmix" : "dsnoop"), d->par.rate, d->par.round, direct_channels(d));
+   return d;
+
+fail:
+   if (d->hdl) sio_close(d->hdl);
+   free(d->mix);
+   free(d->ring);
+   free(d);
+   return NULL;
+}
+
+static bool
+direct_join(snd_pcm_t *pcm, snd_pcm_stream_t stream, int mode)
+{
+   struct direct **d = &direct_shared[stream == SND_PCM_STREAM_CAPTURE];
+   if (!*d && !(*d = direct_open(stream)))
+      return false;
+
+   pcm->direct = *d;
+   pcm->hdl = (*d)->hdl;
+   pcm->direct_next = (*d)->members;
+   (*d)->members = pcm;
+   pcm->mode = mode;
+   pcm->hw.stream = stream;
+   return true;
+}
+
+static void
+direct_leave(snd_pcm_t *pcm)
+{
+   struct direct *d = pcm->direct;
+   for (snd_pcm_t **m = &d->members; *m; m = &(*m)->direct_next) {
+      if (*m == pcm) {
+         *m = pcm->direct_next;
+         break;
+      }
+   }
+
+   pcm->direct = NULL;
+   pcm->hdl = NULL;
+
+   if (d->members)
+      return;
+
+   direct_shared[d->stream == SND_PCM_STREAM_CAPTURE] = NULL;
+   sio_close(d->hdl);
+   free(d->mix);
+   free(d->ring);
+   free(d);
+}
+
+static int
+dsnoop_reserve(struct direct *d, const snd_pcm_uframes_t frames)
+{
+   // members copy out of the ring only when they're called, so it has to hold a whole member buffer
+   if (frames <= d->size)
+      return 0;
+
+   const size_t bpf = d->par.bps * d->par.rchan;
+   adata_t *ring;
+   if (!(ring = calloc(frames, bpf))) {
+      WARN1("calloc");
+      return -ENOMEM;
+   }
+
+   for (snd_pcm_uframes_t i = d->read - MIN(d->read, d->size); i < d->read; ++i)
+      memcpy(ring + (i % frames) * d->par.rchan, d->ring + (i % d->size) * d->par.rchan, bpf);
+
+   free(d->ring);
+   d->ring = ring;
+   d->size = frames;
+   return 0;
+}
+
+static unsigned int
+multi_channels(const struct multi *m)
+{
+   unsigned int chans = m->pchan;
+   for (unsigned int i = 0; i < m->nslaves; ++i)
+      chans += m->slaves[i].par.pchan;
+   return chans;
+}
+
+static void
+multi_onmove(void *arg, int delta)
+{
+   struct multi_slave *s = arg;
+   s->played += delta;
+   s->move_time = get_time_ns();
+}
+
+static void
+multi_close(snd_pcm_t *pcm)
+{
+   for (unsigned int i = 0; i < pcm->multi->nslaves; ++i) {
+      sio_close(pcm->multi->slaves[i].hdl);
+      free(pcm->multi->slaves[i].resamp.ctx);
+   }
+
+   free(pcm->multi->names);
+   free(pcm->multi);
+   pcm->multi = NULL;
+}
+
+static bool
+multi_open(snd_pcm_t *pcm, const char *name, snd_pcm_stream_t stream, int mode)
+{
+   // "multi:rsnd/0,rsnd/1" plays the channels of one frame on several devices, each device its own
+   // channels in order. the first one is the clock, the others are resampled to follow it.
+   if (stream != SND_PCM_STREAM_PLAYBACK) {
+      WARNX1("multi is playback only");
+      return false;
+   }
+
+   if (!(pcm->multi = calloc(1, sizeof(*pcm->multi))) || !(pcm->multi->names = c_strdup(name + strlen("multi:")))) {
+      WARN1("calloc");
+      free(pcm->multi);
+      pcm->multi = NULL;
+      return false;
+   }
+
+   struct multi *m = pcm->multi;
+   char *next = strchr(m->names, ',');
+   if (next)
+      *next++ = 0;
+
+   struct sio_par par;
+   if (!(pcm->hdl = device_open(pcm, m->names, stream, mode)) || !sio_getpar(pcm->hdl, &par))
+      goto fail;
+
+   m->pchan = par.pchan;
+   while (next && *next) {
+      if (m->nslaves == ARRAY_SIZE(m->slaves)) {
+         WARNX("multi: at most %zu devices", ARRAY_SIZE(m->slaves) + 1);
+         goto fail;
+      }
+
+      const char *dev = next;
+      if ((next = strchr(next, ',')))
+         *next++ = 0;
+
+      // the others only have to keep up, they never block
+      struct multi_slave *s = &m->slaves[m->nslaves];
+      if (!(s->hdl = device_connect(dev, SIO_PLAY, SND_PCM_NONBLOCK)))
+         goto fail;
+
+      m->nslaves++;
+      if (!sio_getpar(s->hdl, &s->par))
+         goto fail;
+
+      if (!(s->resamp.ctx = c_aligned_calloc(s->par.pchan * RESAMP_NCTX * sizeof(adata_t)))) {
+         WARN1("calloc");
+         goto fail;
+      }
+
+      s->first = multi_channels(m) - s->par.pchan;
+      sio_onmove(s->hdl, multi_onmove, s);
+   }
+
+   if (multi_channels(m) > NCHAN_MAX) {
+      WARNX("multi: %u channels, at most %d", multi_channels(m), NCHAN_MAX);
+      goto fail;
+   }
+
+   WARNX("multi: %u devices, %u channels", m->nslaves + 1, multi_channels(m));
+   return true;
+
+fail:
+   if (pcm->hdl) sio_close(pcm->hdl);
+   pcm->hdl = NULL;
+   multi_close(pcm);
+   return false;
+}
+
+static bool
+multi_par(snd_pcm_t *pcm, struct sio_par *par)
+{
+   // every device gets the rate and the latency, in adata_t and with its own channels. the first one
+   // decides the block and buffer size, the others only have to keep up with it.
+   struct multi *m = pcm->multi;
+   struct sio_par dev = *par;
+   dev.bits = ADATA_BITS;
+   dev.bps = sizeof(adata_t);
+   dev.sig = 1;
+   dev.le = ADATA_LE;
+   dev.msb = 1;
+   dev.pchan = m->pchan;
+   for (bool retried = false;; retried = true) {
+      if (!device_setpar(pcm->hdl, &dev))
+         return false;
+
+      if (!is_adata_par(&dev) || dev.pchan != m->pchan) {
+         WARNX1("multi: device doesn't take the mixing format");
+         return false;
+      }
+
+      unsigned int appbufsz = dev.appbufsz;
+      for (unsigned int i = 0; i < m->nslaves; ++i) {
+         struct multi_slave *s = &m->slaves[i];
+         struct sio_par spar = dev;
+         spar.pchan = s->par.pchan;
+         if (!device_setpar(s->hdl, &spar) || !is_adata_par(&spar) || spar.pchan != s->par.pchan || spar.rate != dev.rate) {
+            WARNX1("multi: device doesn't take the first device's parameters");
+            return false;
+         }
+         s->par = spar;
+         appbufsz = MIN(appbufsz, spar.appbufsz);
+      }
+
+      // the others are kept as full as the first one, with less buffer they'd drop frames whenever it's
+      // full. ask the first one for the smallest buffer instead, once.
+      if (appbufsz >= dev.appbufsz)
+         break;
+
+      if (retried) {
+         WARNX("multi: devices can't agree on a buffer, %u frames is the most all of them have", appbufsz);
+         return false;
+      }
+
+      WARNX("multi: another device only buffers %u frames, asking the first one for that", appbufsz);
+      dev.appbufsz = appbufsz;
+   }
+
+   pcm->dev = dev;
+   par->rate = dev.rate;
+   par->round = dev.round;
+   par->appbufsz = dev.appbufsz;
+   par->bufsz = dev.bufsz;
+   par->pchan = multi_channels(m);
+   par->rchan = 0;
+   return true;
+}
+
+static void
+dump_enc(const struct sio_enc *enc, struct hw_limits *limits)
+{
+   WARNX("- - - bits: %u bps: %u sig: %u le: %u msb: %u", enc->bits, enc->bps, enc->sig, enc->le, enc->msb);
+   const struct format_info *info = format_info_for_sio_enc(enc);
+   assert(info);
+   WARNX("- - - aka %s", info->name);
+
+   size_t i;
+   for (i = 0; i < ARRAY_SIZE(limits->supported) && limits->supported[i] != SND_PCM_FORMAT_UNKNOWN; ++i);
+   assert(i < ARRAY_SIZE(limits->supported));
+   limits->supported[i] = info->fmt;
+}
+
+static void
+dump_cap(const char *name, const struct sio_cap *cap, struct hw_limits *limits)
+{
+   *limits = (struct hw_limits){0};
+   limits->rate[0] = limits->rchan[0] = limits->pchan[0] = ~(unsigned int)0;
+   memset(limits->supported, SND_PCM_FORMAT_UNKNOWN, sizeof(limits->supported));
+
+   WARNX("* %s", name);
+   for (unsigned int c = 0; c < cap->nconf; ++c) {
+      WARNX("- - configuration %u", c);
+
+      for (unsigned int i = 0; i < SIO_NENC; ++i) {
+         if (cap->confs[c].enc & (1 << i))
+            dump_enc(&cap->enc[i], limits);
+      }
+
+      for (unsigned int i = 0; i < SIO_NCHAN; ++i) {
+         if (!(cap->confs[c].rchan & (1 << i)))
+            continue;
+
+         WARNX("- - - rchan: %u", cap->rchan[i]);
+         limits->rchan[0] = MIN(limits->rchan[0], cap->rchan[i]);
+         limits->rchan[1] = MAX(limits->rchan[1], cap->rchan[i]);
+      }
+
+      for (unsigned int i = 0; i < SIO_NCHAN; ++i) {
+         if (!(cap->confs[c].pchan & (1 << i)))
+            continue;
+
+         WARNX("- - - pchan: %u", cap->pchan[i]);
+         limits->pchan[0] = MIN(limits->pchan[0], cap->pchan[i]);
+         limits->pchan[1] = MAX(limits->pchan[1], cap->pchan[i]);
+      }
+
+      for (unsigned int i = 0; i < SIO_NRATE; ++i) {
+         if (!(cap->confs[c].rate & (1 << i)))
+            continue;
+
+         WARNX("- - - rate: %u", cap->rate[i]);
+         limits->rate[0] = MIN(limits->rate[0], cap->rate[i]);
+         limits->rate[1] = MAX(limits->rate[1], cap->rate[i]);
+      }
    }
+}
+
+// sndiod passes channels through by number, the hardware behind it uses ALSA's usual order
+static const struct chmap_layout {
+   unsigned int channels;
+   unsigned int pos[CMAT_NCHAN_MAX];
+} chmap_layouts[] = {
+   { 1, { SND_CHMAP_MONO } },
+   { 2, { SND_CHMAP_FL, SND_CHMAP_FR } },
+   { 4, { SND_CHMAP_FL, SND_CHMAP_FR, SND_CHMAP_RL, SND_CHMAP_RR } },
+   { 5, { SND_CHMAP_FL, SND_CHMAP_FR, SND_CHMAP_RL, SND_CHMAP_RR, SND_CHMAP_FC } },
+   { 6, { SND_CHMAP_FL, SND_CHMAP_FR, SND_CHMAP_RL, SND_CHMAP_RR, SND_CHMAP_FC, SND_CHMAP_LFE } },
+   { 8, { SND_CHMAP_FL, SND_CHMAP_FR, SND_CHMAP_RL, SND_CHMAP_RR, SND_CHMAP_FC, SND_CHMAP_LFE, SND_CHMAP_SL, SND_CHMAP_SR } },
+};
+
+static const struct chmap_layout*
+chmap_layout_for_channels(const unsigned int channels)
+{
+   for (size_t i = 0; i < ARRAY_SIZE(chmap_layouts); ++i) {
+      if (chmap_layouts[i].channels == channels)
+         return &chmap_layouts[i];
+   }
+   return NULL;
+}
+
+int
+snd_pcm_open(snd_pcm_t **pcm, const char *name, snd_pcm_stream_t stream, int mode)
+{
+   if (!(*pcm = calloc(1, sizeof(**pcm)))) {
+      WARN1("calloc");
+      return -1;
+   }
+
+   const bool direct = direct_wanted(name, stream);
+   if (direct) {
+      if (!direct_join(*pcm, stream, mode))
+         goto fail;
+   } else if (name && !strncmp(name, "multi:", strlen("multi:"))) {
+      if (!multi_open(*pcm, name, stream, mode))
+         goto fail;
+   } else if (!((*pcm)->hdl = device_open(*pcm, name, stream, mode))) {
+      goto fail;
+   }
+
+   sio_initpar(&(*pcm)->hw.par);
+   (*pcm)->name = (name ? name : "default");
+
+   if (direct) {
+      // the shared stream's format, with a buffer of the size sndiod would have given us
+      (*pcm)->hw.cap = (*pcm)->direct->cap;
+      (*pcm)->hw.par = (*pcm)->direct->par;
+      (*pcm)->hw.par.appbufsz = (*pcm)->hw.par.bufsz = MAX((*pcm)->direct->appbufsz - (*pcm)->direct->appbufsz % (*pcm)->hw.par.round, 2 * (*pcm)->hw.par.round);
+   } else if (!sio_getcap((*pcm)->hdl, &(*pcm)->hw.cap) || !sio_getpar((*pcm)->hdl, &(*pcm)->hw.par)) {
+      goto fail;
+   }
+
+   (*pcm)->dev = (*pcm)->hw.par;
+   dump_cap(name, &(*pcm)->hw.cap, &(*pcm)->hw.limits);
+
+   if (direct) {
+      // no resampling in process, and only up to the channels of the shared stream
+      (*pcm)->hw.limits.rate[0] = (*pcm)->hw.limits.rate[1] = (*pcm)->hw.par.rate;
+      (*pcm)->hw.limits.pchan[0] = (*pcm)->hw.limits.rchan[0] = 1;
+      (*pcm)->hw.limits.pchan[1] = (*pcm)->hw.par.pchan;
+      (*pcm)->hw.limits.rchan[1] = (*pcm)->hw.par.rchan;
+   }
+
+   if (!direct && !(*pcm)->multi) {
+      // any layout goes, what the device lacks is remixed, see remix_par
+      const unsigned int most = chmap_layouts[ARRAY_SIZE(chmap_layouts) - 1].channels;
+      struct hw_limits *limits = &(*pcm)->hw.limits;
+      if (limits->pchan[1] > 0) {
+         limits->pchan[0] = 1;
+         limits->pchan[1] = MAX(limits->pchan[1], most);
+      }
+      if (limits->rchan[1] > 0) {
+         limits->rchan[0] = 1;
+         limits->rchan[1] = MAX(limits->rchan[1], most);
+      }
+   }
+
+   if ((*pcm)->multi) {
+      // the frame is all the devices' channels, and nothing else
+      (*pcm)->hw.limits.pchan[0] = (*pcm)->hw.limits.pchan[1] = multi_channels((*pcm)->multi);
+      if (!multi_par(*pcm, &(*pcm)->hw.par)) {
+         sio_close((*pcm)->hdl);
+         multi_close(*pcm);
+         goto fail;
+      }
+   }
+
+   (*pcm)->hw.limits.block_ns = ((*pcm)->hw.par.round * (uint64_t)1e9) / (*pcm)->hw.par.rate;
+   (*pcm)->hw.rate_resample = true;
+   const struct format_info *info = format_info_for_sio_par(&(*pcm)->hw.par);
+   (*pcm)->hw.format = (info ? info->fmt : SND_PCM_FORMAT_UNKNOWN);
+   (*pcm)->hw.period_time = -1;
+   sw_params_default(*pcm);
+   return 0;
+
+fail:
+   free(*pcm);
+   return -1;
+}
+
+int
+snd_pcm_close(snd_pcm_t *pcm)
+{
+   if (pcm->link)
+      snd_pcm_unlink(pcm);
+
+   if (pcm->direct) {
+      direct_leave(pcm);
+   } else {
+      sio_close(pcm->hdl);
+   }
+
+   if (pcm->multi) multi_close(pcm);
+
+   if (pcm->spare) sio_close(pcm->spare);
+   retired_close(pcm, true);
+   free(pcm->mmap.data);
+   free(pcm->mmap.areas);
+   free(pcm->queue.data);
+   free(pcm);
+   return 0;
+}
+
+const char*
+snd_pcm_name(snd_pcm_t *pcm)
+{
+   return pcm->name;
+}
+
+int
+snd_pcm_nonblock(snd_pcm_t *pcm, int nonblock)
+{
+   if ((pcm->mode == SND_PCM_NONBLOCK && nonblock) || (!pcm->mode && !nonblock))
+      return 0;
+
+   WARNX("snd_pcm_nonblock(%d)", nonblock);
+
+   // the connection is shared, changing it is for snd_pcm_link to decide
+   if (pcm->link) {
+      WARNX1("can't change the mode of a linked pcm");
+      return -EBUSY;
+   }
+
+   // the mixer's connection is always non-blocking, blocking happens in snd_pcm_wait
+   if (pcm->direct) {
+      pcm->mode = (nonblock ? SND_PCM_NONBLOCK : 0);
+      return 0;
+   }
+
+   snd_pcm_drain(pcm);
+   sio_close(pcm->hdl);
+
+   if (!(pcm->hdl = device_open(pcm, pcm->name, pcm->hw.stream, (nonblock ? SND_PCM_NONBLOCK : false))))
+      return -1;
+
+   // reopening isn't the app installing new params, keep its sw params
+   const snd_pcm_sw_params_t sw = pcm->sw;
+   snd_pcm_hw_params_t params = pcm->hw;
+   pcm->hw = (snd_pcm_hw_params_t){0};
+   const int ret = snd_pcm_hw_params(pcm, &params);
+   pcm->sw = sw;
+   return ret;
+}
+
+int
+snd_pcm_poll_descriptors_count(snd_pcm_t *pcm)
+{
+   return sio_nfds(pcm->hdl);
+}
+
+static int stream_start(snd_pcm_t *pcm);
+static void playback_flush(snd_pcm_t *pcm, const bool force);
+static int capture_fill(snd_pcm_t *pcm, const snd_pcm_uframes_t want);
+
+int
+snd_pcm_poll_descriptors(snd_pcm_t *pcm, struct pollfd *pfds, unsigned int space)
+{
+   if (space < (unsigned int)sio_nfds(pcm->hdl)) {
+      WARNX("not enough space: %u < %d", space, sio_nfds(pcm->hdl));
+      return -1;
+   }
+
+   // ALSA wants an explicit snd_pcm_start for capture, but a stream that isn't started never wakes up the poll
+   if (pcm->hw.stream == SND_PCM_STREAM_CAPTURE && pcm->state == SND_PCM_STATE_PREPARED)
+      stream_start(pcm);
+
+   // with frames held back or a smaller buffer emulated the device is never full and always writable, wake up on sndio's position
+   // messages instead and let revents decide from avail
+   const int events = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? (wakes_on_moves(pcm) ? 0 : POLLOUT) : POLLIN);
+   const int nfds = sio_pollfd(pcm->hdl, pfds, events);
+
+   // sndio doesn't poll for anything before sio_start, but playback is writable until the start threshold
+   if (!pcm->started && pcm->hw.stream == SND_PCM_STREAM_PLAYBACK) {
+      for (int i = 0; i < nfds; ++i)
+         pfds[i].events |= POLLOUT;
+   }
+
+   return nfds;
+}
+
+int
+snd_pcm_poll_descriptors_revents(snd_pcm_t *pcm, struct pollfd *pfds, unsigned int nfds, unsigned short *revents)
+{
+   if (nfds < (unsigned int)sio_nfds(pcm->hdl)) {
+      WARNX("not enough space: %u < %d", nfds, sio_nfds(pcm->hdl));
+      return -1;
+   }
+
+   if (!pcm->started) {
+      // writing is what starts the playback stream, so there's always room until then
+      if (revents) *revents = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK && pcm->state == SND_PCM_STATE_PREPARED ? POLLOUT : 0);
+      return 0;
+   }
+
+   int ret = sio_revents(pcm->hdl, pfds);
+   if (pcm->direct && pcm->hw.stream == SND_PCM_STREAM_CAPTURE) {
+      // the socket being readable says nothing about this member, the ring does
+      capture_fill(pcm, 0);
+      ret = (ret & ~POLLIN) | (pcm->queue.len >= MAX(pcm->sw.avail_min, 1) ? POLLIN : 0);
+   } else if (wakes_on_moves(pcm)) {
+      playback_flush(pcm, false);
+      ret = (ret & ~POLLOUT) | (snd_pcm_avail(pcm) >= (snd_pcm_sframes_t)MAX(pcm->sw.avail_min, 1) ? POLLOUT : 0);
+   } else {
+      playback_flush(pcm, (ret & POLLOUT));
+   }
+
+   if (revents) *revents = ret;
+   return 0;
+}
+
+snd_pcm_state_t
+snd_pcm_state(snd_pcm_t *pcm)
+{
+   // a non-blocking drain of a mixed stream has nothing in the background to finish it
+   if (pcm->direct && pcm->state == SND_PCM_STATE_DRAINING && pcm->mode == SND_PCM_NONBLOCK)
+      snd_pcm_drain(pcm);
+
+   check_xrun(pcm, get_time_ns());
+   return pcm->state;
+}
+
+snd_pcm_sframes_t
+snd_pcm_bytes_to_frames(snd_pcm_t *pcm, ssize_t bytes)
+{
+   const unsigned int chans = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->hw.par.pchan : pcm->hw.par.rchan);
+   const int bpf = (snd_pcm_format_physical_width(pcm->hw.format) * chans) / 8;
+   return bytes / bpf;
+}
+
+ssize_t
+snd_pcm_frames_to_bytes(snd_pcm_t *pcm, snd_pcm_sframes_t frames)
+{
+   const unsigned int chans = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->hw.par.pchan : pcm->hw.par.rchan);
+   const int bpf = (snd_pcm_format_physical_width(pcm->hw.format) * chans) / 8;
+   return frames * bpf;
+}
+
+struct io {
+   size_t (*read)(void *buffer, size_t size, void *arg);
+   size_t (*write)(const void *buffer, size_t size, void *arg);
+};
+
+struct io_state {
+   snd_pcm_t *pcm;
+   const unsigned char *ptr, *end;
+};
+
+static struct aparams
+device_aparams(const snd_pcm_t *pcm)
+{
+   return (struct aparams){
+      .bps = pcm->hw.par.bps,
+      .bits = pcm->hw.par.bits,
+      .le = pcm->hw.par.le,
+      .sig = pcm->hw.par.sig,
+      .msb = pcm->hw.par.msb
+   };
+}
+
+static struct aparams
+app_aparams(const snd_pcm_t *pcm)
+{
+   const struct format_info *info = format_info_for_format(pcm->hw.format);
+   assert(info);
+
+   // the integer shifts are unused by the float64 codec but must stay within 32 bits
+   return (struct aparams){
+      .bps = info->enc.bps,
+      .bits = MIN(info->enc.bits, 32),
+      .le = info->enc.le,
+      .sig = info->enc.sig,
+      .msb = (info->enc.bits > 32 ? 0 : info->enc.msb)
+   };
+}
+
+static enum codec
+app_codec(const snd_pcm_t *pcm)
+{
+   const struct format_info *info = format_info_for_format(pcm->hw.format);
+   assert(info);
+   return info->codec;
+}
+
+// app format -> adata_t
+static void
+app_decode(const snd_pcm_t *pcm, struct conv *dec, void *in, void *out, int frames)
+{
+   switch (app_codec(pcm)) {
+      case CODEC_LINEAR: dec_do(dec, in, out, frames); break;
+      case CODEC_FLOAT: dec_do_float(dec, in, out, frames); break;
+      case CODEC_FLOAT64: dec_do_float64(dec, in, out, frames); break;
+      case CODEC_MU_LAW: dec_do_ulaw(dec, in, out, frames, 0); break;
+      case CODEC_A_LAW: dec_do_ulaw(dec, in, out, frames, 1); break;
+      case CODEC_NONE: assert(false); break; // never set as the hw format
+   }
+}
+
+// adata_t -> app format
+static void
+app_encode(const snd_pcm_t *pcm, struct conv *enc, void *in, void *out, int frames)
+{
+   switch (app_codec(pcm)) {
+      case CODEC_LINEAR: enc_do(enc, in, out, frames); break;
+      case CODEC_FLOAT: enc_do_float(enc, in, out, frames); break;
+      case CODEC_FLOAT64: enc_do_float64(enc, in, out, frames); break;
+      case CODEC_MU_LAW: enc_do_ulaw(enc, in, out, frames, 0); break;
+      case CODEC_A_LAW: enc_do_ulaw(enc, in, out, frames, 1); break;
+      case CODEC_NONE: assert(false); break; // never set as the hw format
+   }
+}
+
+// silence in the app format, the companded formats don't have zero as their silence
+static void
+app_silence(const snd_pcm_t *pcm, struct conv *enc, void *out, int frames)
+{
+   const struct format_info *info = format_info_for_format(pcm->hw.format);
+   assert(info);
+
+   if (info->codec == CODEC_MU_LAW || info->codec == CODEC_A_LAW) {
+      memset(out, info->silence, frames * enc->nch);
+   } else {
+      enc_sil_do(enc, out, frames);
+   }
+}
+
+static unsigned int
+app_channels(const snd_pcm_t *pcm)
+{
+   return (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->hw.par.pchan : pcm->hw.par.rchan);
+}
+
+static unsigned int
+device_channels(const snd_pcm_t *pcm)
+{
+   // mixed and aggregated streams fit the channels to their devices themselves
+   if (pcm->direct || pcm->multi)
+      return app_channels(pcm);
+
+   return (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->dev.pchan : pcm->dev.rchan);
+}
+
+static bool
+chmap_active(const snd_pcm_t *pcm)
+{
+   return pcm->chmap.channels && pcm->chmap.channels == app_channels(pcm);
+}
+
+static void
+chmap_swizzle(const snd_pcm_t *pcm, adata_t *data, snd_pcm_uframes_t frames)
+{
+   // done on the decoded frames while they are at hand anyway, so reordering costs no pass of its own
+   cperm_do(pcm->chmap.src, pcm->chmap.channels, data, frames);
+}
+
+static int
+remix_coef(const struct chmap_layout *out, const unsigned int pos, const unsigned int c)
+{
+   // same position passes through. what the output lacks goes to its neighbours: the center, the LFE
+   // and mono to both fronts, the rears (or sides) to the fronts on their side, the sides to the rears.
+   // anything goes into mono. nothing makes up channels that weren't there.
+   const int half = 11585; // 1/sqrt(2) at CMAT_UNIT, -3dB
+   const unsigned int to = out->pos[c];
+
+   bool has[SND_CHMAP_LAST + 1] = {0};
+   for (unsigned int i = 0; i < out->channels; ++i)
+      has[out->pos[i]] = true;
+
+   if (to == pos)
+      return CMAT_UNIT;
+
+   if (to == SND_CHMAP_MONO)
+      return (pos == SND_CHMAP_FL || pos == SND_CHMAP_FR ? CMAT_UNIT : half);
+
+   if (has[pos])
+      return 0;
+
+   switch (pos) {
+      case SND_CHMAP_MONO: return (to == SND_CHMAP_FL || to == SND_CHMAP_FR ? CMAT_UNIT : 0);
+      case SND_CHMAP_FC:
+      case SND_CHMAP_LFE: return (to == SND_CHMAP_FL || to == SND_CHMAP_FR ? half : 0);
+      case SND_CHMAP_SL: if (has[SND_CHMAP_RL]) return (to == SND_CHMAP_RL ? CMAT_UNIT : 0); // fallthrough
+      case SND_CHMAP_RL: return (to == SND_CHMAP_FL ? half : 0);
+      case SND_CHMAP_SR: if (has[SND_CHMAP_RR]) return (to == SND_CHMAP_RR ? CMAT_UNIT : 0); // fallthrough
+      case SND_CHMAP_RR: return (to == SND_CHMAP_FR ? half : 0);
+   }
+
+   return 0;
+}
+
+static bool
+remix_subset(const snd_pcm_stream_t stream, const unsigned int want, const unsigned int have)
+{
+   // recording fewer channels than a wide input device gives: the first ones are kept and the rest is
+   // never decoded. layouts we know are mixed down instead.
+   return (stream == SND_PCM_STREAM_CAPTURE && have > want && !(chmap_layout_for_channels(want) && chmap_layout_for_channels(have)));
+}
+
+static void
+subset_cut(unsigned char *data, const size_t frames, const size_t ibpf, const size_t obpf)
+{
+   // in place, the leading channels of each frame move down to where the previous one now ends
+   for (size_t f = 1; f < frames; ++f)
+      memmove(data + f * obpf, data + f * ibpf, obpf);
+}
+
+static void
+remix_init(struct cmat *mat, const unsigned int nin, const unsigned int nout)
+{
+   const struct chmap_layout *in = chmap_layout_for_channels(nin), *out = chmap_layout_for_channels(nout);
+   assert(in && out);
+
+   cmat_init(mat, nin, nout);
+   for (unsigned int o = 0; o < nout; ++o) {
+      int *row = mat->coef + o * nin, sum = 0;
+      for (unsigned int i = 0; i < nin; ++i)
+         sum += (row[i] = remix_coef(out, in->pos[i], o));
+
+      // a channel summing more than full scale is scaled down so it can't clip
+      for (unsigned int i = 0; sum > CMAT_UNIT && i < nin; ++i)
+         row[i] = ((long long)row[i] * CMAT_UNIT) / sum;
+   }
+}
+
+static size_t
+convert(snd_pcm_t *pcm, const size_t frames, const struct io *io, void *arg)
+{
+   struct aparams params[2] = { app_aparams(pcm), device_aparams(pcm) };
+
+   const unsigned int di = (pcm->hw.stream == SND_PCM_STREAM_CAPTURE);
+   const unsigned int ei = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK);
+   const unsigned int chans[2] = { app_channels(pcm), device_channels(pcm) };
+   const bool subset = remix_subset(pcm->hw.stream, chans[0], chans[1]);
+   const bool remix = (chans[0] != chans[1] && !subset);
+
+   // decoded holds the input channels and mixed the output channels, both as adata_t
+   unsigned char decoded[16384], encoded[sizeof(decoded)];
+   adata_t mixed[sizeof(decoded) / sizeof(adata_t)];
+   const size_t dec_frames = sizeof(decoded) / (MAX(params[di].bps, sizeof(adata_t)) * chans[di]);
+   const size_t enc_frames = sizeof(encoded) / (MAX(params[ei].bps, sizeof(adata_t)) * chans[ei]);
+   const size_t max_frames = MIN(dec_frames, enc_frames);
+
+   struct conv dec, enc;
+   struct cmat mat;
+   dec_init(&dec, &params[di], (subset ? chans[0] : chans[di]));
+   enc_init(&enc, &params[ei], chans[ei]);
+   if (remix)
+      remix_init(&mat, chans[di], chans[ei]);
+
+   size_t io_bytes = 0;
+   for (size_t total_frames = frames; total_frames > 0;) {
+      size_t todo_frames = MIN(max_frames, total_frames);
+      assert(todo_frames <= total_frames);
+      total_frames -= todo_frames;
+
+      adata_t *out = (adata_t*)decoded;
+
+      {
+         const size_t todo_bytes = todo_frames * (params[di].bps * chans[di]);
+         const size_t ret = io->read(encoded, todo_bytes, arg) / (params[di].bps * chans[di]);
+         assert(ret <= todo_frames);
+         todo_frames = ret;
+
+         // the unused channels are dropped before any work is done on them, in the device's format
+         // there's nothing else to do
+         if (subset) {
+            subset_cut(encoded, todo_frames, params[di].bps * chans[di], params[di].bps * chans[0]);
+            if (!pcm->hw.needs_conversion && !chmap_active(pcm)) {
+               io_bytes += io->write(encoded, todo_frames * (params[ei].bps * chans[ei]), arg);
+               continue;
+            }
+         }
+
+         // the device side is always linear
+         if (ei) {
+            app_decode(pcm, &dec, encoded, decoded, todo_frames);
+         } else {
+            dec_do(&dec, encoded, decoded, todo_frames);
+         }
+
+         // the app's order is reordered on the app's channels, before the mix when playing and after it
+         // when recording
+         if (ei && chmap_active(pcm))
+            chmap_swizzle(pcm, out, todo_frames);
+
+         if (remix) {
+            cmat_do(&mat, decoded, mixed, todo_frames);
+            out = mixed;
+         }
+
+         if (di && chmap_active(pcm))
+            chmap_swizzle(pcm, out, todo_frames);
+      }
+
+      {
+         const size_t todo_bytes = todo_frames * (params[ei].bps * chans[ei]);
+
+         if (di) {
+            app_encode(pcm, &enc, out, encoded, todo_frames);
+         } else {
+            enc_do(&enc, (unsigned char*)out, encoded, todo_frames);
+         }
+
+         io_bytes += io->write(encoded, todo_bytes, arg);
+      }
+   }
+
+   return io_bytes / (params[ei].bps * chans[ei]);
+}
+
+static size_t
+cb_buffer_read(void *buffer, size_t bytes, void *arg)
+{
+   struct io_state *state = arg;
+   assert(state->ptr + bytes <= state->end);
+   memcpy(buffer, state->ptr, bytes);
+   state->ptr += bytes;
+   return bytes;
+}
+
+static size_t
+cb_sio_write(const void *buffer, size_t bytes, void *arg)
+{
+   struct io_state *state = arg;
+   return sio_write(state->pcm->hdl, buffer, bytes);
+}
+
+static snd_pcm_uframes_t multi_write(snd_pcm_t *pcm, const void *buffer, snd_pcm_uframes_t frames);
+
+static snd_pcm_uframes_t
+device_write(snd_pcm_t *pcm, const void *buffer, snd_pcm_uframes_t frames)
+{
+   const struct io io = { .read = cb_buffer_read, .write = cb_sio_write };
+   struct io_state state = { .pcm = pcm, .ptr = buffer, .end = (unsigned char*)buffer + snd_pcm_frames_to_bytes(pcm, frames) };
+
+   snd_pcm_uframes_t ret;
+   if (pcm->multi) {
+      ret = multi_write(pcm, buffer, frames);
+   } else if (pcm->hw.needs_conversion || chmap_active(pcm) || device_channels(pcm) != app_channels(pcm)) {
+      ret = convert(pcm, frames, &io, &state);
+   } else {
+      ret = snd_pcm_bytes_to_frames(pcm, io.write(buffer, snd_pcm_frames_to_bytes(pcm, frames), &state));
+   }
+
+   pcm->sent += ret;
+   return ret;
+}
+
+static void
+queue_push(snd_pcm_t *pcm, const unsigned char *buffer, snd_pcm_uframes_t frames)
+{
+   assert(pcm->queue.len + frames <= pcm->queue.size);
+
+   if (!pcm->queue.len)
+      pcm->queue.time = get_time_ns();
+
+   while (frames > 0) {
+      const snd_pcm_uframes_t tail = (pcm->queue.head + pcm->queue.len) % pcm->queue.size;
+      const snd_pcm_uframes_t todo = MIN(frames, pcm->queue.size - tail);
+      memcpy(pcm->queue.data + snd_pcm_frames_to_bytes(pcm, tail), buffer, snd_pcm_frames_to_bytes(pcm, todo));
+      buffer += snd_pcm_frames_to_bytes(pcm, todo);
+      pcm->queue.len += todo;
+      frames -= todo;
+   }
+}
+
+static void
+queue_push_silence(snd_pcm_t *pcm, snd_pcm_uframes_t frames)
+{
+   struct aparams params = app_aparams(pcm);
+   struct conv enc;
+   enc_init(&enc, &params, pcm->hw.par.pchan);
+
+   unsigned char silence[4096];
+   const snd_pcm_uframes_t max_frames = sizeof(silence) / snd_pcm_frames_to_bytes(pcm, 1);
+   while (frames > 0) {
+      const snd_pcm_uframes_t todo = MIN(frames, max_frames);
+      app_silence(pcm, &enc, silence, todo);
+      queue_push(pcm, silence, todo);
+      frames -= todo;
+   }
+}
+
+static void
+queue_flush(snd_pcm_t *pcm, snd_pcm_uframes_t frames)
+{
+   while (frames > 0 && pcm->queue.len > 0) {
+      const snd_pcm_uframes_t todo = MIN(MIN(frames, pcm->queue.len), pcm->queue.size - pcm->queue.head);
+      const snd_pcm_uframes_t ret = device_write(pcm, pcm->queue.data + snd_pcm_frames_to_bytes(pcm, pcm->queue.head), todo);
+      pcm->queue.head = (pcm->queue.head + ret) % pcm->queue.size;
+      pcm->queue.len -= ret;
+      frames -= ret;
+
+      if (ret < todo)
+         break;
+   }
+
+   if (!pcm->queue.len)
+      pcm->queue.time = 0;
+}
+
+static void
+device_write_silence(snd_pcm_t *pcm, snd_pcm_uframes_t frames)
+{
+   // an aggregate splits the frames itself, so it gets its silence in the app format
+   struct aparams params = (pcm->multi ? app_aparams(pcm) : device_aparams(pcm));
+   struct conv enc;
+   enc_init(&enc, &params, device_channels(pcm));
+
+   unsigned char encoded[16384];
+   const size_t bpf = params.bps * device_channels(pcm);
+   while (frames > 0) {
+      const snd_pcm_uframes_t todo = MIN(frames, sizeof(encoded) / bpf);
+      if (pcm->multi) {
+         app_silence(pcm, &enc, encoded, todo);
+      } else {
+         enc_sil_do(&enc, encoded, todo);
+      }
+      const snd_pcm_uframes_t ret = (pcm->multi ? multi_write(pcm, encoded, todo) : sio_write(pcm->hdl, encoded, todo * bpf) / bpf);
+      assert(pcm->avail >= ret);
+      pcm->sent += ret;
+      pcm->avail -= ret;
+      frames -= ret;
+
+      if (ret < todo)
+         break;
+   }
+}
+
+static void
+device_sync(struct sio_hdl *hdl)
+{
+   // let sndio process the position messages it already has, without waiting for anything
+   struct pollfd pfd[16];
+   int nfds = sio_nfds(hdl);
+   assert((unsigned int)nfds < ARRAY_SIZE(pfd));
+   nfds = sio_pollfd(hdl, pfd, 0);
+   if (poll(pfd, nfds, 0) >= 0)
+      sio_revents(hdl, pfd);
+}
+
+static void
+dmix_add(snd_pcm_t *pcm, adata_t *mix, snd_pcm_uframes_t frames)
+{
+   // the next queued frames go into the block being mixed. a stream that had nothing for the blocks
+   // before (started, paused or underran) just continues with this one.
+   struct direct *d = pcm->direct;
+   if ((pcm->state != SND_PCM_STATE_RUNNING && pcm->state != SND_PCM_STATE_DRAINING) || !pcm->queue.len)
+      return;
+
+   if (pcm->direct_base + pcm->sent < d->mixed)
+      pcm->direct_base = d->mixed - pcm->sent;
+
+   struct aparams params = app_aparams(pcm);
+   struct conv dec;
+   struct cmap cmap;
+   dec_init(&dec, &params, pcm->hw.par.pchan);
+   cmap_init(&cmap, 0, pcm->hw.par.pchan - 1, 0, pcm->hw.par.pchan - 1, 0, d->par.pchan - 1, 0, d->par.pchan - 1);
+
+   // like sndiod does for a stream of its own, fewer channels than the device's are repeated across it
+   const unsigned int expand = d->par.pchan / pcm->hw.par.pchan;
+
+   adata_t decoded[4096];
+   const snd_pcm_uframes_t max_frames = ARRAY_SIZE(decoded) / pcm->hw.par.pchan;
+   for (frames = MIN(frames, pcm->queue.len); frames > 0;) {
+      const snd_pcm_uframes_t todo = MIN(MIN(frames, max_frames), pcm->queue.size - pcm->queue.head);
+      unsigned char *encoded = pcm->queue.data + snd_pcm_frames_to_bytes(pcm, pcm->queue.head);
+
+      app_decode(pcm, &dec, encoded, decoded, todo);
+
+      if (chmap_active(pcm))
+         chmap_swizzle(pcm, decoded, todo);
+
+      for (unsigned int e = 0; e < expand; ++e)
+         cmap_add(&cmap, decoded, mix + e * pcm->hw.par.pchan, ADATA_UNIT, todo);
+
+      mix += todo * d->par.pchan;
+      pcm->queue.head = (pcm->queue.head + todo) % pcm->queue.size;
+      pcm->queue.len -= todo;
+      pcm->sent += todo;
+      frames -= todo;
+   }
+
+   if (!pcm->queue.len)
+      pcm->queue.time = 0;
+}
+
+static bool
+dmix_ready(const struct direct *d)
+{
+   // every running member has a whole block queued, mixing it now doesn't leave a gap in any of them
+   for (const snd_pcm_t *pcm = d->members; pcm; pcm = pcm->direct_next) {
+      if (pcm->state == SND_PCM_STATE_RUNNING && pcm->queue.len < d->par.round)
+         return false;
+   }
+   return true;
+}
+
+static void
+dmix_mix(struct direct *d)
+{
+   // blocks are mixed only when the device has room for them, until then the frames stay in each
+   // stream's queue where they can still be dropped or rewound. whichever member calls in does the
+   // mixing for all of them. past the two blocks the device needs to not run dry between onmoves
+   // it's mixed ahead as far as the members have frames for, so it lasts while nobody calls in.
+   device_sync(d->hdl);
+
+   const size_t bpf = d->par.bps * d->par.pchan;
+   while (1) {
+      if (d->pending) {
+         const snd_pcm_uframes_t ret = sio_write(d->hdl, d->mix, d->pending * bpf) / bpf;
+         memmove(d->mix, (unsigned char*)d->mix + ret * bpf, (d->pending - ret) * bpf);
+         d->pending -= ret;
+         d->sent += ret;
+
+         if (d->pending)
+            return;
+      }
+
+      const snd_pcm_uframes_t fill = d->mixed - d->position;
+      // sndio only starts playing once the buffer is full, so the first time it's filled regardless
+      if (fill + d->par.round > d->par.appbufsz || (d->position && fill >= 2 * d->par.round && !dmix_ready(d)))
+         return;
+
+      memset(d->mix, 0, d->par.round * bpf);
+      for (snd_pcm_t *pcm = d->members; pcm; pcm = pcm->direct_next)
+         dmix_add(pcm, d->mix, d->par.round);
+
+      d->mixed += d->par.round;
+      d->pending = d->par.round;
+   }
+}
+
+static int
+dmix_drain(snd_pcm_t *pcm)
+{
+   // the shared stream goes on for the others, so instead of sio_stop wait for our own frames to play.
+   // draining, running dry at the end isn't an underrun. non-blocking, snd_pcm_state finishes it.
+   struct direct *d = pcm->direct;
+   const int block_ms = (d->par.round * 1000) / d->par.rate + 1;
+   const uint64_t stall_ns = ((d->par.appbufsz + d->par.round) * (uint64_t)1e9) / d->par.rate;
+
+   pcm->state = SND_PCM_STATE_DRAINING;
+   while (1) {
+      dmix_mix(d);
+      if (!pcm->queue.len && pcm->sent <= pcm->position)
+         break;
+
+      // the device would have played its whole buffer by now, what's left of ours never will
+      if (get_time_ns() - d->move_time >= stall_ns) {
+         WARNX("shared stream stalled, %lu frames not played", pcm->queue.len + pcm->sent - pcm->position);
+         break;
+      }
+
+      if (pcm->mode == SND_PCM_NONBLOCK)
+         return -EAGAIN;
+
+      struct pollfd pfd[16];
+      int nfds = sio_nfds(d->hdl);
+      assert((unsigned int)nfds < ARRAY_SIZE(pfd));
+      nfds = sio_pollfd(d->hdl, pfd, 0);
+      if (poll(pfd, nfds, block_ms) >= 0)
+         sio_revents(d->hdl, pfd);
+   }
+
+   return 0;
+}
+
+#define MULTI_RATIO_UNIT 32000
+
+static void
+multi_adjust(snd_pcm_t *pcm, struct multi_slave *s, const uint64_t now)
+{
+   // keep every device as far ahead as the first one. a device with a slower clock fills up, so it gets
+   // fewer frames for each frame written, a faster one more. a difference is corrected within about a
+   // second, by at most 1%.
+   if (pcm->state != SND_PCM_STATE_RUNNING || !pcm->move_time || !s->move_time)
+      return;
+
+   const snd_pcm_uframes_t since = MIN(((now - MIN(now, s->move_time)) * s->par.rate) / (uint64_t)1e9, s->par.round);
+   const double fill = (double)(s->written - s->played) - MIN(since, s->written - s->played);
+   const double ref = (double)(pcm->sent - interpolated_position(pcm, now));
+   s->err += ((fill - ref) - s->err) / 16;
+
+   const double max = MULTI_RATIO_UNIT / 100;
+   const double adj = MIN(MAX(-s->err * MULTI_RATIO_UNIT / s->par.rate, -max), max);
+   const unsigned int oblksz = MULTI_RATIO_UNIT + (int)(adj < 0 ? adj - 0.5 : adj + 0.5);
+   if (oblksz == s->resamp.oblksz && s->resamp.iblksz == MULTI_RATIO_UNIT)
+      return;
+
+   // keep the phase between the two input frames being interpolated
+   s->resamp.diff = ((long long)s->resamp.diff * oblksz) / s->resamp.oblksz;
+   s->resamp.iblksz = MULTI_RATIO_UNIT;
+   s->resamp.oblksz = oblksz;
+}
+
+static void
+multi_slave_write(struct multi_slave *s, const unsigned int chans, adata_t *decoded, const snd_pcm_uframes_t frames)
+{
+   const unsigned int nch = s->par.pchan;
+   struct cmap cmap;
+   cmap_init(&cmap, 0, chans - 1, s->first, s->first + nch - 1, s->first, s->first + nch - 1, s->first, s->first + nch - 1);
+
+   adata_t part[4096], resampled[4096 + 4096 / 64 + 2 * NCHAN_MAX];
+   cmap_copy(&cmap, decoded, part, ADATA_UNIT, frames);
+
+   int icnt = frames, ocnt = ARRAY_SIZE(resampled) / nch;
+   resamp_getcnt(&s->resamp, &icnt, &ocnt);
+   resamp_do(&s->resamp, part, resampled, icnt, ocnt);
+
+   // never blocks, what doesn't fit is lost and the ratio catches up
+   const size_t bpf = nch * sizeof(adata_t);
+   const snd_pcm_uframes_t ret = sio_write(s->hdl, resampled, ocnt * bpf) / bpf;
+   s->written += ret;
+
+   if (ret < (snd_pcm_uframes_t)ocnt) {
+      s->dropped += ocnt - ret;
+      WARNX("multi: device %u full, dropped %lu frames", s->first, ocnt - ret);
+   }
+}
+
+static snd_pcm_uframes_t
+multi_write(snd_pcm_t *pcm, const void *buffer, snd_pcm_uframes_t frames)
+{
+   // decoded once, then every device gets its channels of the frames. the first device takes what it
+   // takes (blocking or not), the others then get the same frames.
+   struct multi *m = pcm->multi;
+   const uint64_t now = get_time_ns();
+   for (unsigned int i = 0; i < m->nslaves; ++i) {
+      device_sync(m->slaves[i].hdl);
+      multi_adjust(pcm, &m->slaves[i], now);
+   }
+
+   const unsigned int chans = pcm->hw.par.pchan;
+   struct aparams params = app_aparams(pcm);
+   struct conv dec;
+   struct cmap cmap;
+   dec_init(&dec, &params, chans);
+   cmap_init(&cmap, 0, chans - 1, 0, m->pchan - 1, 0, m->pchan - 1, 0, m->pchan - 1);
+
+   adata_t decoded[4096], part[4096];
+   const snd_pcm_uframes_t max_frames = ARRAY_SIZE(decoded) / chans;
+   const size_t bpf = m->pchan * sizeof(adata_t);
+   unsigned char *ptr = (unsigned char*)buffer;
+   snd_pcm_uframes_t total = 0;
+   while (total < frames) {
+      const snd_pcm_uframes_t todo = MIN(frames - total, max_frames);
+      app_decode(pcm, &dec, ptr, decoded, todo);
+
+      if (chmap_active(pcm))
+         chmap_swizzle(pcm, decoded, todo);
+
+      cmap_copy(&cmap, decoded, part, ADATA_UNIT, todo);
+      const snd_pcm_uframes_t ret = sio_write(pcm->hdl, part, todo * bpf) / bpf;
+      for (unsigned int i = 0; i < m->nslaves; ++i)
+         multi_slave_write(&m->slaves[i], chans, decoded, ret);
+
+      ptr += snd_pcm_frames_to_bytes(pcm, ret);
+      total += ret;
+
+      if (ret < todo)
+         break;
+   }
+
+   return total;
+}
+
+static void
+playback_silence(snd_pcm_t *pcm)
+{
+   // what is sent can't be overwritten like in a ALSA ring buffer, so silence delays everything written
+   // after it. only top up to the threshold when the device is about to run dry, a threshold of 0
+   // (ALSA's "fill the whole buffer") means one block.
+   if (!pcm->sw.silence_size || pcm->queue.len || pcm->state != SND_PCM_STATE_RUNNING)
+      return;
+
+   const snd_pcm_uframes_t threshold = (pcm->sw.silence_threshold ? pcm->sw.silence_threshold : pcm->hw.par.round);
+   const snd_pcm_uframes_t fill = pcm->sent - pcm->position;
+   if (fill < threshold)
+      device_write_silence(pcm, MIN(MIN(pcm->sw.silence_size, threshold - fill), pcm->avail));
+}
+
+static void
+playback_flush(snd_pcm_t *pcm, const bool force)
+{
+   // small writes are combined and handed to sndio in whole par.round blocks. the remainder is only
+   // written when it has waited for a block's worth of time or the device is about to run dry.
+   if (pcm->direct && pcm->hw.stream == SND_PCM_STREAM_PLAYBACK) {
+      dmix_mix(pcm->direct);
+      return;
+   }
+
+   if (pcm->retired)
+      retired_close(pcm, false);
+
+   if (pcm->hw.stream != SND_PCM_STREAM_PLAYBACK || pcm->state != SND_PCM_STATE_RUNNING || !pcm->hw.par.round || !pcm->hw.par.rate)
+      return;
+
+   if (!pcm->queue.len) {
+      playback_silence(pcm);
+      return;
+   }
+
+   // until the first onmove everything goes to the device, it won't start before it's full
+   snd_pcm_uframes_t frames = pcm->queue.len;
+   if (!force && pcm->move_time) {
+      const uint64_t block_ns = (pcm->hw.par.round * (uint64_t)1e9) / pcm->hw.par.rate;
+      const snd_pcm_uframes_t fill = pcm->sent - pcm->position;
+      const bool starving = (pcm->move_time && fill <= pcm->hw.par.round);
+      const bool stale = (get_time_ns() - pcm->queue.time >= block_ns);
+
+      // the newest frames stay rewindable, unless the device would run out before the next onmove
+      const snd_pcm_uframes_t window = held_back(pcm);
+      frames -= MIN(frames, window);
+      if (!starving && !stale)
+         frames -= frames % pcm->hw.par.round;
+
+      if (window && fill < 2 * pcm->hw.par.round)
+         frames = MAX(frames, MIN(pcm->queue.len, 2 * pcm->hw.par.round - fill));
+   }
+
+   queue_flush(pcm, frames);
+}
+
+snd_pcm_sframes_t
+snd_pcm_writei(snd_pcm_t *pcm, const void *buffer, snd_pcm_uframes_t size)
+{
+   if (pcm->hw.stream != SND_PCM_STREAM_PLAYBACK) {
+      WARNX1("trying to write to capture stream :/");
+      return 0;
+   }
+
+   if (snd_pcm_state(pcm) == SND_PCM_STATE_XRUN)
+      return -EPIPE;
+
+   if (pcm->state != SND_PCM_STATE_PREPARED && pcm->state != SND_PCM_STATE_RUNNING && pcm->state != SND_PCM_STATE_PAUSED) {
+      WARNX1("playback hasn't been prepared");
+      return -EBADFD;
+   }
+
+   const unsigned char *ptr = buffer;
+   snd_pcm_uframes_t total = 0;
+   while (total < size) {
+      if (!app_avail(pcm)) {
+         // nothing makes room while paused
+         if (pcm->state == SND_PCM_STATE_PAUSED)
+            break;
+
+         // a start threshold beyond the buffer would never be reached, start when full instead
+         if (pcm->state == SND_PCM_STATE_PREPARED && stream_start(pcm) < 0)
+            break;
+
+         // the queue is what is left between us and sndio, push it out and block for space.
+         // held back frames stay, snd_pcm_wait then waits for the onmove instead.
+         playback_flush(pcm, !wakes_on_moves(pcm));
+
+         if (pcm->mode == SND_PCM_NONBLOCK)
+            break;
+
+         if (snd_pcm_wait(pcm, -1) > 0 && !pcm->avail) {
+            // sndio woke us up but hasn't told about the move yet, let sio_write do the blocking
+            const snd_pcm_uframes_t ret = device_write(pcm, ptr, MIN(size - total, pcm->hw.par.round));
+            assert(pcm->avail >= ret);
+            ptr += snd_pcm_frames_to_bytes(pcm, ret);
+            pcm->written += ret;
+            pcm->avail -= ret;
+            total += ret;
+         }
+         continue;
+      }
+
+      const snd_pcm_uframes_t todo = MIN(size - total, app_avail(pcm));
+      queue_push(pcm, ptr, todo);
+      ptr += snd_pcm_frames_to_bytes(pcm, todo);
+      pcm->written += todo;
+      pcm->avail -= todo;
+      total += todo;
+
+      if (pcm->state == SND_PCM_STATE_PREPARED && pcm->written >= pcm->sw.start_threshold && stream_start(pcm) < 0)
+         break;
+
+      playback_flush(pcm, false);
+   }
+
+   return (total || !size ? (snd_pcm_sframes_t)total : -EAGAIN);
+}
+
+static size_t
+cb_buffer_write(const void *buffer, size_t bytes, void *arg)
+{
+   struct io_state *state = arg;
+   assert(state->ptr + bytes <= state->end);
+   memcpy((void*)state->ptr, buffer, bytes);
+   state->ptr += bytes;
+   return bytes;
+}
+
+static size_t
+cb_sio_read(void *buffer, size_t bytes, void *arg)
+{
+   struct io_state *state = arg;
+   return sio_read(state->pcm->hdl, buffer, bytes);
+}
+
+static snd_pcm_uframes_t
+device_read(snd_pcm_t *pcm, void *buffer, snd_pcm_uframes_t frames)
+{
+   const struct io io = { .read = cb_sio_read, .write = cb_buffer_write };
+   struct io_state state = { .pcm = pcm, .ptr = buffer, .end = (unsigned char*)buffer + snd_pcm_frames_to_bytes(pcm, frames) };
+
+   snd_pcm_uframes_t ret;
+   if (pcm->hw.needs_conversion || chmap_active(pcm) || device_channels(pcm) != app_channels(pcm)) {
+      ret = convert(pcm, frames, &io, &state);
+   } else {
+      ret = snd_pcm_bytes_to_frames(pcm, io.read(buffer, snd_pcm_frames_to_bytes(pcm, frames), &state));
+   }
+
+   pcm->sent += ret;
+   return ret;
+}
+
+static void
+dsnoop_read(struct direct *d)
+{
+   // whichever member calls in reads everything sndio has into the ring, once for all of them
+   device_sync(d->hdl);
+
+   const size_t bpf = d->par.bps * d->par.rchan;
+   while (1) {
+      const snd_pcm_uframes_t tail = d->read % d->size;
+      const snd_pcm_uframes_t ret = sio_read(d->hdl, d->ring + tail * d->par.rchan, (d->size - tail) * bpf) / bpf;
+      d->read += ret;
+
+      if (ret < d->size - tail)
+         break;
+   }
+}
+
+static int
+dsnoop_wait(struct direct *d)
+{
+   struct pollfd pfd[16];
+   int nfds = sio_nfds(d->hdl);
+   assert((unsigned int)nfds < ARRAY_SIZE(pfd));
+   nfds = sio_pollfd(d->hdl, pfd, POLLIN);
+   if (poll(pfd, nfds, (d->par.round * 1000) / d->par.rate + 1) >= 0) {
+      sio_revents(d->hdl, pfd);
+   } else if (errno != EINTR) {
+      WARN1("poll");
+      return -EIO;
+   }
+
+   if (sio_eof(d->hdl)) {
+      WARNX1("shared stream failed");
+      return -EIO;
+   }
+
+   return 0;
+}
+
+static int
+dsnoop_fill(snd_pcm_t *pcm, const snd_pcm_uframes_t want)
+{
+   // like capture_fill, but out of the shared ring, converted to this member's format and channels.
+   // what was recorded is still handed out when waiting for the rest fails.
+   struct direct *d = pcm->direct;
+   const uint64_t start = get_time_ns();
+   const uint64_t stall_ns = ((d->par.appbufsz + d->par.round) * (uint64_t)1e9) / d->par.rate;
+   dsnoop_read(d);
+
+   int err = 0;
+   snd_pcm_uframes_t todo = MIN(MAX(pcm->position - pcm->sent, want), pcm->queue.size - pcm->queue.len);
+   while (pcm->direct_base + pcm->sent + todo > d->read && want > 0) {
+      if (pcm->mode == SND_PCM_NONBLOCK) {
+         err = -EAGAIN;
+         break;
+      }
+
+      // the device would have recorded its whole buffer by now, the rest isn't coming
+      if (get_time_ns() - MAX(d->move_time, start) >= stall_ns) {
+         WARNX1("shared stream stalled");
+         err = -EIO;
+         break;
+      }
+
+      if ((err = dsnoop_wait(d)) < 0)
+         break;
+
+      dsnoop_read(d);
+   }
+
+   // fell behind more than the ring holds, the oldest frames are gone (and it has overrun already)
+   if (pcm->direct_base + pcm->sent + d->size < d->read)
+      pcm->sent = d->read - d->size - pcm->direct_base;
+
+   struct aparams params = app_aparams(pcm);
+   struct conv enc;
+   struct cmap cmap;
+   enc_init(&enc, &params, pcm->hw.par.rchan);
+   cmap_init(&cmap, 0, d->par.rchan - 1, 0, d->par.rchan - 1, 0, pcm->hw.par.rchan - 1, 0, pcm->hw.par.rchan - 1);
+
+   adata_t copied[4096];
+   const snd_pcm_uframes_t max_frames = ARRAY_SIZE(copied) / pcm->hw.par.rchan;
+   todo = MIN(todo, d->read - MIN(d->read, pcm->direct_base + pcm->sent));
+   while (todo > 0) {
+      const snd_pcm_uframes_t head = (pcm->direct_base + pcm->sent) % d->size;
+      const snd_pcm_uframes_t tail = (pcm->queue.head + pcm->queue.len) % pcm->queue.size;
+      const snd_pcm_uframes_t n = MIN(MIN(MIN(todo, max_frames), d->size - head), pcm->queue.size - tail);
+      unsigned char *encoded = pcm->queue.data + snd_pcm_frames_to_bytes(pcm, tail);
+
+      cmap_copy(&cmap, d->ring + head * d->par.rchan, copied, ADATA_UNIT, n);
+      if (chmap_active(pcm))
+         chmap_swizzle(pcm, copied, n);
+
+      app_encode(pcm, &enc, copied, encoded, n);
+
+      pcm->queue.len += n;
+      pcm->sent += n;
+      todo -= n;
+   }
+
+   return err;
+}
+
+static int
+capture_fill(snd_pcm_t *pcm, const snd_pcm_uframes_t want)
+{
+   // read everything sndio has told us about in one go, reads of what's already recorded don't block.
+   // `want` frames more than that are only asked for when the caller is fine with blocking.
+   if (!pcm->started)
+      return 0; // paused, what was read ahead is all there is
+
+   if (pcm->direct)
+      return dsnoop_fill(pcm, want);
+
+   snd_pcm_uframes_t todo = MIN(MAX(pcm->position - pcm->sent, want), pcm->queue.size - pcm->queue.len);
+   while (todo > 0) {
+      const snd_pcm_uframes_t tail = (pcm->queue.head + pcm->queue.len) % pcm->queue.size;
+      const snd_pcm_uframes_t contiguous = MIN(todo, pcm->queue.size - tail);
+      const snd_pcm_uframes_t ret = device_read(pcm, pcm->queue.data + snd_pcm_frames_to_bytes(pcm, tail), contiguous);
+      pcm->queue.len += ret;
+      todo -= ret;
+
+      if (ret < contiguous)
+         break;
+   }
+
+   return 0;
+}
+
+static void
+capture_consume(snd_pcm_t *pcm, const snd_pcm_uframes_t frames)
+{
+   assert(pcm->queue.len >= frames && pcm->avail >= frames);
+   pcm->queue.head = (pcm->queue.head + frames) % pcm->queue.size;
+   pcm->queue.len -= frames;
+   pcm->written += frames;
+   pcm->avail -= frames;
+}
+
+snd_pcm_sframes_t
+snd_pcm_readi(snd_pcm_t *pcm, void *buffer, snd_pcm_uframes_t size)
+{
+   if (pcm->hw.stream != SND_PCM_STREAM_CAPTURE) {
+      WARNX1("trying to read from playback stream :/");
+      return 0;
+   }
+
+   if (snd_pcm_state(pcm) == SND_PCM_STATE_XRUN)
+      return -EPIPE;
+
+   if (pcm->state != SND_PCM_STATE_PREPARED && pcm->state != SND_PCM_STATE_RUNNING && pcm->state != SND_PCM_STATE_PAUSED) {
+      WARNX1("recording hasn't been prepared");
+      return -EBADFD;
+   }
+
+   // reading is what starts capture, ALSA does the same with a start threshold of 1
+   if (pcm->state == SND_PCM_STATE_PREPARED && stream_start(pcm) < 0)
+      return -EIO;
+
+   unsigned char *ptr = buffer;
+   snd_pcm_uframes_t total = 0;
+   while (total < size) {
+      if (pcm->queue.len < size - total) {
+         const int err = capture_fill(pcm, (pcm->mode == SND_PCM_NONBLOCK ? 0 : size - total - pcm->queue.len));
+         if (err < 0 && !pcm->queue.len && !total)
+            return err;
+
+         if (!pcm->queue.len)
+            break;
+      }
+
+      const snd_pcm_uframes_t todo = MIN(MIN(size - total, pcm->queue.len), pcm->queue.size - pcm->queue.head);
+      memcpy(ptr, pcm->queue.data + snd_pcm_frames_to_bytes(pcm, pcm->queue.head), snd_pcm_frames_to_bytes(pcm, todo));
+      ptr += snd_pcm_frames_to_bytes(pcm, todo);
+      capture_consume(pcm, todo);
+      total += todo;
+   }
+
+   return (total || !size ? (snd_pcm_sframes_t)total : -EAGAIN);
+}
+
+int
+snd_pcm_mmap_begin(snd_pcm_t *pcm, const snd_pcm_channel_area_t **areas, snd_pcm_uframes_t *offset, snd_pcm_uframes_t *frames)
+{
+   snd_pcm_uframes_t todo_frames = app_avail(pcm);
+   if (frames) todo_frames = MIN(todo_frames, *frames);
+
+   unsigned char *base = pcm->mmap.data;
+   snd_pcm_uframes_t base_offset = 0;
+   if (pcm->hw.stream == SND_PCM_STREAM_CAPTURE) {
+      if (pcm->state == SND_PCM_STATE_PREPARED && stream_start(pcm) < 0)
+         return -EIO;
+
+      // capture windows point straight into the read-ahead queue, mmap_commit consumes them
+      if (pcm->queue.len < todo_frames)
+         capture_fill(pcm, 0);
+
+      todo_frames = MIN(MIN(todo_frames, pcm->queue.len), pcm->queue.size - pcm->queue.head);
+      base = pcm->queue.data;
+      base_offset = pcm->queue.head;
+   }
+
+   if (offset) *offset = base_offset;
+   if (frames) *frames = todo_frames;
+   if (areas) {
+      const unsigned int chans = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->hw.par.pchan : pcm->hw.par.rchan);
+      const unsigned int bits = snd_pcm_format_physical_width(pcm->hw.format);
+      for (unsigned int i = 0; i < chans; ++i)
+         pcm->mmap.areas[i] = (snd_pcm_channel_area_t){ .addr = base, .first = bits * i, .step = bits * chans };
+      *areas = pcm->mmap.areas;
+   }
+
+   return 0;
+}
+
+snd_pcm_sframes_t
+snd_pcm_mmap_commit(snd_pcm_t *pcm, snd_pcm_uframes_t offset, snd_pcm_uframes_t frames)
+{
+   if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK)
+      return snd_pcm_writei(pcm, pcm->mmap.data, frames);
+
+   frames = MIN(frames, pcm->queue.len);
+   capture_consume(pcm, frames);
+   return frames;
+}
+
+int
+snd_pcm_wait(snd_pcm_t *pcm, int timeout)
+{
+   if (pcm->state == SND_PCM_STATE_XRUN)
+      return -EPIPE; // sndio has paused, nothing is going to wake us up
+
+   if (pcm->state == SND_PCM_STATE_PAUSED)
+      return 0; // nor will anything change until unpaused
+
+   if (!pcm->started) {
+      // playback is writable until writing starts it, capture has to be running to ever get ready
+      if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK || pcm->state != SND_PCM_STATE_PREPARED)
+         return (pcm->state == SND_PCM_STATE_PREPARED);
+
+      if (stream_start(pcm) < 0)
+         return 0;
+   }
+
+   // the polls may wake up early for the queue or the next move, the caller's timeout is for the whole call
+   const uint64_t deadline = (timeout >= 0 ? get_time_ns() + timeout * (uint64_t)1e6 : 0);
+   while (1) {
+      const uint64_t start = get_time_ns();
+
+      int poll_timeout = -1;
+      if (timeout >= 0)
+         poll_timeout = (deadline > start ? (int)((deadline - start + (uint64_t)1e6 - 1) / (uint64_t)1e6) : 0);
+
+      if (pcm->hw.stream == SND_PCM_STREAM_CAPTURE) {
+         // another member may already have read our frames off the socket
+         if (pcm->direct)
+            capture_fill(pcm, 0);
+
+         if (pcm->queue.len > 0 && pcm->queue.len >= pcm->sw.avail_min)
+            break; // already read ahead
+      } else {
+         // don't sleep past the point where the combined writes have to reach the device
+         playback_flush(pcm, false);
+
+         if (wakes_on_moves(pcm)) {
+            const snd_pcm_sframes_t avail = snd_pcm_avail(pcm);
+            if (avail < 0)
+               return avail;
+
+            if (avail >= (snd_pcm_sframes_t)MAX(pcm->sw.avail_min, 1))
+               break;
+
+            // the device is never full, so wait for the next block to play instead of POLLOUT.
+            // aim at when it's due rather than a block from now, with small buffers that's all the slack there is.
+            const uint64_t block_ns = (pcm->hw.par.round * (uint64_t)1e9) / pcm->hw.par.rate;
+            const uint64_t due = (pcm->move_time ? pcm->move_time : start) + block_ns;
+            const int due_ms = (due - MIN(start, due)) / (uint64_t)1e6 + 1;
+            poll_timeout = (poll_timeout < 0 ? due_ms : MIN(poll_timeout, due_ms));
+         } else if (pcm->queue.len) {
+            const uint64_t block_ns = (pcm->hw.par.round * (uint64_t)1e9) / pcm->hw.par.rate;
+            const uint64_t left_ms = (pcm->queue.time + block_ns - MIN(start, pcm->queue.time + block_ns)) / (uint64_t)1e6 + 1;
+            poll_timeout = (poll_timeout < 0 ? (int)left_ms : MIN(poll_timeout, (int)left_ms));
+         }
+      }
+
+      struct pollfd pfd[16];
+      int nfds = sio_nfds(pcm->hdl);
+      assert((unsigned int)nfds < ARRAY_SIZE(pfd));
 
-   if (!((*pcm)->hdl = device_open(*pcm, name, stream, mode)))
-      goto fail;
+      const int want = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? (wakes_on_moves(pcm) ? 0 : POLLOUT) : POLLIN);
+      nfds = sio_pollfd(pcm->hdl, pfd, want);
 
-   sio_initpar(&(*pcm)->hw.par);
-   (*pcm)->name = (name ? name : "default");
+      errno = 0;
+      while ((nfds = poll(pfd, nfds, poll_timeout)) < 0) {
+         if (errno == EINVAL) {
+            WARNX1("poll EINVAL");
+            goto nodata;
+         } else if (errno == EINTR) {
+            WARNX1("poll EINTR");
+            goto nodata;
+         } else if (errno != EAGAIN)
+            goto nodata; // timeout
+      }
 
-   if (!sio_getcap((*pcm)->hdl, &(*pcm)->hw.cap) || !sio_getpar((*pcm)->hdl, &(*pcm)->hw.par))
-      goto fail;
+      if (sio_revents(pcm->hdl, pfd) & want)
+         break;
 
-   dump_cap(name, &(*pcm)->hw.cap, &(*pcm)->hw.limits);
-   const struct format_info *info = format_info_for_sio_par(&(*pcm)->hw.par);
-   (*pcm)->hw.format = (info ? info->fmt : SND_PCM_FORMAT_UNKNOWN);
-   (*pcm)->hw.period_time = -1;
+      if (timeout >= 0 && get_time_ns() >= deadline)
+         goto nodata; // timeout
+   }
+   return 1;
+
+nodata:
    return 0;
+}
 
-fail:
-   free(*pcm);
-   return -1;
+snd_pcm_sframes_t
+snd_pcm_avail_update(snd_pcm_t *pcm)
+{
+   while (snd_pcm_wait(pcm, pcm->hw.period_time) > 0 && app_avail(pcm) < pcm->sw.avail_min);
+   return snd_pcm_avail(pcm);
+}
+
+snd_pcm_sframes_t
+snd_pcm_avail(snd_pcm_t *pcm)
+{
+   if (snd_pcm_state(pcm) == SND_PCM_STATE_XRUN)
+      return -EPIPE;
+
+   playback_flush(pcm, false);
+   return app_avail(pcm);
 }
 
 int
-snd_pcm_close(snd_pcm_t *pcm)
+snd_pcm_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
 {
-   sio_close(pcm->hdl);
-   free(pcm->mmap.data);
-   free(pcm);
+   if (delayp) *delayp = delay_at(pcm, get_time_ns());
    return 0;
 }
 
-const char*
-snd_pcm_name(snd_pcm_t *pcm)
+int
+snd_pcm_avail_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *availp, snd_pcm_sframes_t *delayp)
 {
-   return pcm->name;
+   const uint64_t now = get_time_ns();
+   if (availp) *availp = snd_pcm_avail(pcm);
+   if (delayp) *delayp = delay_at(pcm, now);
+   return 0;
 }
 
 int
-snd_pcm_nonblock(snd_pcm_t *pcm, int nonblock)
+snd_pcm_htimestamp(snd_pcm_t *pcm, snd_pcm_uframes_t *avail, snd_htimestamp_t *tstamp)
 {
-   if ((pcm->mode == SND_PCM_NONBLOCK && nonblock) || (!pcm->mode && !nonblock))
-      return 0;
+   // avail only changes on onmove, so the timestamp of that is the one matching it
+   if (avail) *avail = snd_pcm_avail(pcm);
+   if (tstamp) ns_to_tstamp(pcm, (pcm->move_time ? pcm->move_time : pcm->trigger_time), tstamp);
+   return 0;
+}
 
-   WARNX("snd_pcm_nonblock(%d)", nonblock);
-   snd_pcm_drain(pcm);
-   sio_close(pcm->hdl);
+static bool
+is_mmap_access(const snd_pcm_access_t access)
+{
+   return (access == SND_PCM_ACCESS_MMAP_INTERLEAVED || access == SND_PCM_ACCESS_MMAP_NONINTERLEAVED || access == SND_PCM_ACCESS_MMAP_COMPLEX);
+}
 
-   if (!(pcm->hdl = device_open(pcm, pcm->name, pcm->hw.stream, (nonblock ? SND_PCM_NONBLOCK : false))))
-      return -1;
+static void
+ensure_mmap_buffer(snd_pcm_t *pcm)
+{
+   free(pcm->mmap.data);
+   free(pcm->mmap.areas);
+   pcm->mmap.data = NULL;
 
-   snd_pcm_hw_params_t params = pcm->hw;
-   pcm->hw = (snd_pcm_hw_params_t){0};
-   return snd_pcm_hw_params(pcm, &params);
+   if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK && is_mmap_access(pcm->hw.access) && !(pcm->mmap.data = calloc(1, snd_pcm_frames_to_bytes(pcm, pcm->hw.par.bufsz))))
+      ERR1(EXIT_FAILURE, "realloc");
+
+   // capture hands out areas into the queue, so both directions get them
+   if (!(pcm->mmap.areas = c_aligned_calloc(app_channels(pcm) * sizeof(*pcm->mmap.areas))))
+      ERR1(EXIT_FAILURE, "calloc");
 }
 
-int
-snd_pcm_poll_descriptors_count(snd_pcm_t *pcm)
+static void
+ensure_queue_buffer(snd_pcm_t *pcm)
 {
-   return sio_nfds(pcm->hdl);
+   free(pcm->queue.data);
+   pcm->queue = (struct queue){0};
+
+   if (!(pcm->queue.data = calloc(1, snd_pcm_frames_to_bytes(pcm, pcm->hw.par.bufsz))))
+      ERR1(EXIT_FAILURE, "calloc");
+
+   pcm->queue.size = pcm->hw.par.bufsz;
 }
 
-int
-snd_pcm_poll_descriptors(snd_pcm_t *pcm, struct pollfd *pfds, unsigned int space)
+static void
+reset_position(snd_pcm_t *pcm)
 {
-   if (space < (unsigned int)sio_nfds(pcm->hdl)) {
-      WARNX("not enough space: %u < %d", space, sio_nfds(pcm->hdl));
-      return -1;
+   pcm->written = pcm->position = pcm->sent = 0;
+   pcm->queue.head = pcm->queue.len = pcm->queue.time = 0;
+   pcm->avail = pcm->hw.par.bufsz * (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK);
+   pcm->move_time = 0;
+}
+
+static bool
+device_setpar(struct sio_hdl *hdl, struct sio_par *par)
+{
+   if (!par->__magic) {
+      // sndio sets magic to 0 after getpar, so it becomes "uninitialized".
+      // using "uninitialized" par in setpar fails. however, due to how asound
+      // design is, we really want to use our getparred pars in setpar, so
+      // lets force the initialized state here.
+      struct sio_par tmp;
+      sio_initpar(&tmp);
+      par->__magic = tmp.__magic;
+      par->bufsz = ~0U; // read-only
    }
 
-   return sio_pollfd(pcm->hdl, pfds, (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? POLLOUT : POLLIN));
+   if (!sio_setpar(hdl, par)) {
+      WARNX1("sio_setpar failed");
+      return false;
+   }
+
+   struct sio_par hpar;
+   if (!sio_getpar(hdl, &hpar)) {
+      WARNX1("sio_getpar failed");
+      return false;
+   }
+
+   *par = hpar;
+   return true;
 }
 
-int
-snd_pcm_poll_descriptors_revents(snd_pcm_t *pcm, struct pollfd *pfds, unsigned int nfds, unsigned short *revents)
+// sio_flush is only in sndio >= 1.9, check for it at runtime so older libsndio still works
+#pragma weak sio_flush
+int sio_flush(struct sio_hdl *hdl);
+
+static int
+device_flush(snd_pcm_t *pcm)
 {
-   if (nfds < (unsigned int)sio_nfds(pcm->hdl)) {
-      WARNX("not enough space: %u < %d", nfds, sio_nfds(pcm->hdl));
-      return -1;
+   // stop right away and throw away what sndio still has buffered, sio_stop would play it out first
+   if (pcm->hw.stream == SND_PCM_STREAM_CAPTURE && !pcm->link) {
+      // nothing to play out when recording
+      return (sio_stop(pcm->hdl) ? 0 : -1);
+   } else if (sio_flush) {
+      return (sio_flush(pcm->hdl) ? 0 : -1);
+   } else if (pcm->link) {
+      // a shared connection can't be reopened from one side, let it play out
+      return (sio_stop(pcm->hdl) ? 0 : -1);
    }
 
-   const int ret = sio_revents(pcm->hdl, pfds);
-   if (revents) *revents = ret;
+   // older libsndio, the only way to get rid of the buffer is a new connection
+   WARNX1("no sio_flush, reopening the device");
+   sio_close(pcm->hdl);
+   if (!(pcm->hdl = device_open(pcm, pcm->name, pcm->hw.stream, pcm->mode)))
+      return -1;
+
+   struct sio_par par = pcm->dev;
+   if (!device_setpar(pcm->hdl, &par))
+      return -1;
+
+   if (par.bufsz != pcm->dev.bufsz || par.round != pcm->dev.round)
+      WARNX1("device came back with different parameters");
+
+   pcm->dev = par;
    return 0;
 }
 
-snd_pcm_state_t
-snd_pcm_state(snd_pcm_t *pcm)
+static void
+retired_close(snd_pcm_t *pcm, const bool force)
 {
-   if (pcm->started)
-      return SND_PCM_STATE_RUNNING;
+   // sio_close drains a started handle, so wait until the swapped out one has played out its buffer.
+   // when forced whatever it still has is thrown away.
+   if (!pcm->retired || (!force && get_time_ns() < pcm->retire_time))
+      return;
+
+   if (force && get_time_ns() < pcm->retire_time && sio_flush && !sio_flush(pcm->retired))
+      WARNX1("sio_flush failed");
 
-   return SND_PCM_STATE_OPEN;
+   sio_close(pcm->retired);
+   pcm->retired = NULL;
 }
 
-snd_pcm_sframes_t
-snd_pcm_bytes_to_frames(snd_pcm_t *pcm, ssize_t bytes)
+static void
+multi_start(snd_pcm_t *pcm)
 {
-   const unsigned int chans = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->hw.par.pchan : pcm->hw.par.rchan);
-   const int bpf = (snd_pcm_format_physical_width(pcm->hw.format) * chans) / 8;
-   return bytes / bpf;
+   // the others start with the first, from unity ratio
+   for (unsigned int i = 0; i < pcm->multi->nslaves; ++i) {
+      struct multi_slave *s = &pcm->multi->slaves[i];
+      if (!sio_start(s->hdl))
+         WARNX1("sio_start failed");
+
+      s->written = s->played = s->move_time = 0;
+      s->err = 0;
+      resamp_init(&s->resamp, MULTI_RATIO_UNIT, MULTI_RATIO_UNIT, s->par.pchan);
+   }
 }
 
-ssize_t
-snd_pcm_frames_to_bytes(snd_pcm_t *pcm, snd_pcm_sframes_t frames)
+static void
+multi_stop(snd_pcm_t *pcm, const bool drain)
 {
-   const unsigned int chans = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->hw.par.pchan : pcm->hw.par.rchan);
-   const int bpf = (snd_pcm_format_physical_width(pcm->hw.format) * chans) / 8;
-   return frames * bpf;
+   for (unsigned int i = 0; i < pcm->multi->nslaves; ++i) {
+      struct multi_slave *s = &pcm->multi->slaves[i];
+      if (!(drain || !sio_flush ? sio_stop(s->hdl) : sio_flush(s->hdl)))
+         WARNX1("sio_stop failed");
+   }
 }
 
-struct io {
-   size_t (*read)(void *buffer, size_t size, void *arg);
-   size_t (*write)(const void *buffer, size_t size, void *arg);
-};
+static int
+stream_start(snd_pcm_t *pcm)
+{
+   // after a resync sndio is still running, carry on with its clock and the drift estimate
+   if (!pcm->started) {
+      if (!pcm->direct && !sio_start(pcm->hdl)) {
+         WARNX1("sio_start failed");
+         return -1;
+      }
 
-struct io_state {
-   snd_pcm_t *pcm;
-   const unsigned char *ptr, *end;
-};
+      // the shared stream is already running, follow it from here
+      if (pcm->direct)
+         pcm->direct_base = pcm->direct->position - pcm->position;
 
-static size_t
-convert(snd_pcm_t *pcm, const size_t frames, const struct io *io, void *arg)
-{
-   const struct format_info *info = format_info_for_format(pcm->hw.format);
-   assert(info);
+      if (pcm->multi)
+         multi_start(pcm);
 
-   struct aparams params[2] = {
-      {
-         .bps = info->enc.bps,
-         .bits = info->enc.bits,
-         .le = info->enc.le,
-         .sig = info->enc.sig,
-         .msb = info->enc.msb
-      }, {
-         .bps = pcm->hw.par.bps,
-         .bits = pcm->hw.par.bits,
-         .le = pcm->hw.par.le,
-         .sig = pcm->hw.par.sig,
-         .msb = pcm->hw.par.msb
+      pcm->started = true;
+      pcm->move_time = 0;
+      drift_reset(pcm);
+
+      if (pcm->link) {
+         pcm->link->started = true;
+         pcm->link->move_time = 0;
+         drift_reset(pcm->link);
       }
-   };
+   }
 
-   const unsigned int di = (pcm->hw.stream == SND_PCM_STREAM_CAPTURE);
-   const unsigned int ei = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK);
-   const unsigned int chans = (ei ? pcm->hw.par.pchan : pcm->hw.par.rchan);
+   WARNX1("started");
+   pcm->state = SND_PCM_STATE_RUNNING;
+   pcm->trigger_time = get_time_ns();
 
-   unsigned char decoded[16384], encoded[sizeof(decoded)];
-   const size_t dec_frames = sizeof(decoded) / (params[di].bps * chans);
-   const size_t enc_frames = sizeof(encoded) / (params[ei].bps * chans);
-   const size_t max_frames = MIN(dec_frames, enc_frames);
+   // linked streams start together, from the same sio_start
+   if (pcm->link && pcm->link->state == SND_PCM_STATE_PREPARED) {
+      pcm->link->state = SND_PCM_STATE_RUNNING;
+      pcm->link->trigger_time = pcm->trigger_time;
+      playback_flush(pcm->link, true);
+   }
 
-   struct conv dec, enc;
-   dec_init(&dec, &params[di], chans);
-   enc_init(&enc, &params[ei], chans);
+   // whatever was written before the start threshold, or the silence prefill
+   playback_flush(pcm, true);
+   return 0;
+}
 
-   size_t io_bytes = 0;
-   for (size_t total_frames = frames; total_frames > 0;) {
-      size_t todo_frames = MIN(max_frames, total_frames);
-      assert(todo_frames <= total_frames);
-      total_frames -= todo_frames;
+static void
+stream_resync(snd_pcm_t *pcm)
+{
+   // sndio keeps the stream through an xrun (SIO_IGNORE), playback waits on an empty buffer and capture
+   // on a full one. rebase the app side on the device instead of a sio_stop/sio_start round trip.
+   device_sync(pcm->hdl);
+
+   pcm->queue.head = pcm->queue.len = pcm->queue.time = 0;
+   while (pcm->hw.stream == SND_PCM_STREAM_CAPTURE && pcm->sent < pcm->position) {
+      // what was recorded before the overrun is stale, read it out of sndio's way
+      const snd_pcm_uframes_t sent = pcm->sent;
+      capture_fill(pcm, 0);
+      pcm->queue.head = pcm->queue.len = 0;
+
+      if (pcm->sent == sent)
+         break;
+   }
 
-      {
-         const size_t todo_bytes = todo_frames * (params[di].bps * chans);
-         const size_t ret = io->read(encoded, todo_bytes, arg) / (params[di].bps * chans);
-         assert(ret <= todo_frames);
-         todo_frames = ret;
+   // frames the device still has keep playing and their onmoves arrive later, keep them accounted
+   pcm->direct_base += MIN(pcm->position, pcm->sent);
+   pcm->sent -= MIN(pcm->position, pcm->sent);
+   pcm->position = pcm->written = 0;
+   pcm->avail = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->hw.par.bufsz - pcm->sent : 0);
+   pcm->move_time = 0; // the last onmove was before the stall, don't extrapolate from it
+
+   // the device clock didn't change, keep its rate. the phase belongs to the old positions though,
+   // it restarts with the next onmove.
+   pcm->drift.time = 0;
+   WARNX("resynced, %lu frames still in the device", pcm->sent);
+}
 
-         // sadly can't function pointer here as some formats may need different parameters for decoder
-         if (ei && (pcm->hw.format == SND_PCM_FORMAT_FLOAT_LE || pcm->hw.format == SND_PCM_FORMAT_FLOAT_BE)) {
-            dec_do_float(&dec, encoded, decoded, todo_frames);
-         } else {
-            dec_do(&dec, encoded, decoded, todo_frames);
-         }
+static int
+stream_stop(snd_pcm_t *pcm, const bool drain)
+{
+   if (pcm->started) {
+      if (pcm->direct) {
+         // the shared stream keeps running for the others. what was already mixed still plays
+         // when dropping, that's at most the shared stream's buffer.
+         int ret;
+         if (drain && (ret = dmix_drain(pcm)) < 0)
+            return ret;
+      } else if (drain ? !sio_stop(pcm->hdl) : device_flush(pcm) < 0) {
+         return -1;
       }
 
-      {
-         const size_t todo_bytes = todo_frames * (params[ei].bps * chans);
+      // after draining the current handle the swapped out one is long done too
+      retired_close(pcm, !drain);
 
-         // sadly can't function pointer here as some formats may need different parameters for decoder
-         if (di && (pcm->hw.format == SND_PCM_FORMAT_FLOAT_LE || pcm->hw.format == SND_PCM_FORMAT_FLOAT_BE)) {
-            enc_do_float(&enc, decoded, encoded, todo_frames);
-         } else {
-            enc_do(&enc, decoded, encoded, todo_frames);
-         }
+      if (pcm->multi)
+         multi_stop(pcm, drain);
 
-         io_bytes += io->write(encoded, todo_bytes, arg);
+      WARNX("%s", (drain ? "drained" : "dropped"));
+      pcm->started = false;
+
+      // and so did the other direction
+      if (pcm->link) {
+         pcm->link->started = false;
+         reset_position(pcm->link);
       }
    }
 
-   return io_bytes / (params[ei].bps * chans);
+   reset_position(pcm);
+   return 0;
 }
 
-static size_t
-cb_buffer_read(void *buffer, size_t bytes, void *arg)
+static void
+link_follow(snd_pcm_t *pcm)
 {
-   struct io_state *state = arg;
-   assert(state->ptr + bytes <= state->end);
-   memcpy(buffer, state->ptr, bytes);
-   state->ptr += bytes;
-   return bytes;
+   // what happened to the shared stream happened to both directions
+   if (!pcm->link || pcm->link->state == SND_PCM_STATE_OPEN)
+      return;
+
+   pcm->link->state = pcm->state;
+   pcm->link->trigger_time = pcm->trigger_time;
 }
 
-static size_t
-cb_sio_write(const void *buffer, size_t bytes, void *arg)
+static bool
+is_transferring(const snd_pcm_t *pcm)
 {
-   struct io_state *state = arg;
-   return sio_write(state->pcm->hdl, buffer, bytes);
+   return (pcm->state == SND_PCM_STATE_PREPARED || pcm->state == SND_PCM_STATE_RUNNING || pcm->state == SND_PCM_STATE_PAUSED);
 }
 
 snd_pcm_sframes_t
-snd_pcm_writei(snd_pcm_t *pcm, const void *buffer, snd_pcm_uframes_t size)
+snd_pcm_rewindable(snd_pcm_t *pcm)
 {
-   if (pcm->hw.stream != SND_PCM_STREAM_PLAYBACK) {
-      WARNX1("trying to write to capture stream :/");
-      return 0;
-   }
+   if (pcm->state == SND_PCM_STATE_XRUN)
+      return -EPIPE;
 
-   if (!pcm->started) {
-      WARNX1("playback hasn't been started");
-      return 0;
-   }
+   if (!is_transferring(pcm))
+      return -EBADFD;
 
-   const struct io io = { .read = cb_buffer_read, .write = cb_sio_write };
-   struct io_state state = { .pcm = pcm, .ptr = buffer, .end = (unsigned char*)buffer + snd_pcm_frames_to_bytes(pcm, size) };
+   // playback can take back what hasn't been handed to sndio yet. capture can go back over frames that
+   // were already read from the read-ahead ring as long as sio_read hasn't overwritten them.
+   if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK)
+      return pcm->queue.len;
 
-   snd_pcm_uframes_t ret;
-   if (pcm->hw.needs_conversion) {
-      ret = convert(pcm, size, &io, &state);
+   return MIN(pcm->written, pcm->queue.size - pcm->queue.len);
+}
+
+snd_pcm_sframes_t
+snd_pcm_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t frames)
+{
+   const snd_pcm_sframes_t rewindable = snd_pcm_rewindable(pcm);
+   if (rewindable < 0)
+      return rewindable;
+
+   frames = MIN(frames, (snd_pcm_uframes_t)rewindable);
+   if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK) {
+      pcm->queue.len -= frames;
+      if (!pcm->queue.len)
+         pcm->queue.time = 0;
    } else {
-      ret = snd_pcm_bytes_to_frames(pcm, io.write(buffer, snd_pcm_frames_to_bytes(pcm, size), &state));
+      pcm->queue.head = (pcm->queue.head + pcm->queue.size - frames) % pcm->queue.size;
+      pcm->queue.len += frames;
    }
 
-   assert(pcm->avail >= ret);
-   pcm->written += ret;
-   pcm->avail -= ret;
-   return ret;
+   pcm->written -= frames;
+   pcm->avail += frames;
+   return frames;
 }
 
-static size_t
-cb_buffer_write(const void *buffer, size_t bytes, void *arg)
+snd_pcm_sframes_t
+snd_pcm_forwardable(snd_pcm_t *pcm)
 {
-   struct io_state *state = arg;
-   assert(state->ptr + bytes <= state->end);
-   memcpy((void*)state->ptr, buffer, bytes);
-   state->ptr += bytes;
-   return bytes;
+   if (pcm->state == SND_PCM_STATE_XRUN)
+      return -EPIPE;
+
+   if (!is_transferring(pcm))
+      return -EBADFD;
+
+   if (pcm->hw.stream == SND_PCM_STREAM_CAPTURE)
+      capture_fill(pcm, 0);
+
+   return app_avail(pcm);
 }
 
-static size_t
-cb_sio_read(void *buffer, size_t bytes, void *arg)
+snd_pcm_sframes_t
+snd_pcm_forward(snd_pcm_t *pcm, snd_pcm_uframes_t frames)
 {
-   struct io_state *state = arg;
-   return sio_read(state->pcm->hdl, buffer, bytes);
+   const snd_pcm_sframes_t forwardable = snd_pcm_forwardable(pcm);
+   if (forwardable < 0)
+      return forwardable;
+
+   frames = MIN(frames, (snd_pcm_uframes_t)forwardable);
+   if (pcm->hw.stream == SND_PCM_STREAM_CAPTURE) {
+      frames = MIN(frames, pcm->queue.len);
+      capture_consume(pcm, frames);
+      return frames;
+   }
+
+   // there's no ring buffer to leave untouched, skipped frames are played as silence
+   queue_push_silence(pcm, frames);
+   pcm->written += frames;
+   pcm->avail -= frames;
+
+   if (pcm->state == SND_PCM_STATE_PREPARED && pcm->written >= pcm->sw.start_threshold && stream_start(pcm) < 0)
+      return -EIO;
+
+   playback_flush(pcm, false);
+   return frames;
 }
 
-snd_pcm_sframes_t
-snd_pcm_readi(snd_pcm_t *pcm, void *buffer, snd_pcm_uframes_t size)
+int
+snd_pcm_prepare(snd_pcm_t *pcm)
 {
-   if (pcm->hw.stream != SND_PCM_STREAM_CAPTURE) {
-      WARNX1("trying to read from playback stream :/");
-      return 0;
+   if (!pcm->queue.data) {
+      // first prepare and the device defaults were accepted as is
+      ensure_mmap_buffer(pcm);
+      ensure_queue_buffer(pcm);
    }
 
-   if (!pcm->started) {
-      WARNX1("recording hasn't been started");
-      return 0;
+   if (pcm->state == SND_PCM_STATE_XRUN) {
+      stream_resync(pcm);
+   } else if (stream_stop(pcm, false) < 0) {
+      // anything still pending is discarded, like after snd_pcm_drop
+      return -1;
    }
 
-   const struct io io = { .read = cb_sio_read, .write = cb_buffer_write };
-   struct io_state state = { .pcm = pcm, .ptr = buffer, .end = (unsigned char*)buffer + snd_pcm_frames_to_bytes(pcm, size) };
+   // sio_start is deferred until the start threshold is reached
+   pcm->state = SND_PCM_STATE_PREPARED;
+   link_follow(pcm);
+   return 0;
+}
 
-   snd_pcm_uframes_t ret;
-   if (pcm->hw.needs_conversion) {
-      ret = convert(pcm, size, &io, &state);
-   } else {
-      ret = snd_pcm_bytes_to_frames(pcm, io.read(buffer, snd_pcm_frames_to_bytes(pcm, size), &state));
-   }
+int
+snd_pcm_start(snd_pcm_t *pcm)
+{
+   if (pcm->state == SND_PCM_STATE_RUNNING)
+      return 0;
 
-   assert(pcm->avail >= ret);
-   pcm->written += ret;
-   pcm->avail -= ret;
-   return ret;
+   if (pcm->state != SND_PCM_STATE_PREPARED && snd_pcm_prepare(pcm) < 0)
+      return -1;
+
+   return stream_start(pcm);
 }
 
 int
-snd_pcm_mmap_begin(snd_pcm_t *pcm, const snd_pcm_channel_area_t **areas, snd_pcm_uframes_t *offset, snd_pcm_uframes_t *frames)
+snd_pcm_drain(snd_pcm_t *pcm)
 {
-   snd_pcm_uframes_t todo_frames = pcm->avail;
-   if (frames) todo_frames = MIN(todo_frames, *frames);
+   // frames that never reached the start threshold are still played
+   if (pcm->state == SND_PCM_STATE_PREPARED && pcm->queue.len && stream_start(pcm) < 0)
+      return -1;
 
-   if (pcm->hw.stream == SND_PCM_STREAM_CAPTURE)
-      todo_frames = snd_pcm_readi(pcm, pcm->mmap.data, todo_frames);
+   if (pcm->state == SND_PCM_STATE_PAUSED)
+      pcm->state = SND_PCM_STATE_RUNNING;
 
-   if (offset) *offset = 0;
-   if (frames) *frames = todo_frames;
-   if (areas) {
-      const unsigned int chans = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->hw.par.pchan : pcm->hw.par.rchan);
-      for (unsigned int i = 0; i < chans; ++i)
-         pcm->mmap.areas[i].addr = pcm->mmap.data + snd_pcm_format_size(pcm->hw.format, todo_frames) * i;
-      *areas = pcm->mmap.areas;
-   }
+   playback_flush(pcm, true);
+
+   int ret;
+   if ((ret = stream_stop(pcm, (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK))) < 0)
+      return ret;
+
+   if (pcm->state != SND_PCM_STATE_OPEN)
+      pcm->state = SND_PCM_STATE_SETUP;
 
+   link_follow(pcm);
    return 0;
 }
 
-snd_pcm_sframes_t
-snd_pcm_mmap_commit(snd_pcm_t *pcm, snd_pcm_uframes_t offset, snd_pcm_uframes_t frames)
+int
+snd_pcm_drop(snd_pcm_t *pcm)
 {
-   if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK)
-      return snd_pcm_writei(pcm, pcm->mmap.data, frames);
+   if (stream_stop(pcm, false) < 0)
+      return -1;
 
-   return frames;
+   if (pcm->state != SND_PCM_STATE_OPEN)
+      pcm->state = SND_PCM_STATE_SETUP;
+
+   link_follow(pcm);
+   return 0;
 }
 
-static uint64_t
-get_time_ns(void)
+int
+snd_pcm_resume(snd_pcm_t *pcm)
 {
-   struct timespec ts;
-   clock_gettime(CLOCK_MONOTONIC, &ts);
-   return (uint64_t)ts.tv_sec * (uint64_t)1e9 + (uint64_t)ts.tv_nsec;
+   // streams never get suspended, ALSA apps fall back to snd_pcm_prepare on -ENOSYS
+   return -ENOSYS;
 }
 
 int
-snd_pcm_wait(snd_pcm_t *pcm, int timeout)
+snd_pcm_pause(snd_pcm_t *pcm, int enable)
 {
-   while (1) {
-      const uint64_t start = get_time_ns();
+   WARNX("%d", enable);
 
-      struct pollfd pfd[16];
-      int nfds = sio_nfds(pcm->hdl);
-      assert((unsigned int)nfds < ARRAY_SIZE(pfd));
+   if (enable) {
+      if (pcm->state != SND_PCM_STATE_RUNNING)
+         return -EBADFD;
 
-      const int want = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? POLLOUT : POLLIN);
-      nfds = sio_pollfd(pcm->hdl, pfd, want);
+      // playback just stops feeding, sndio plays out what it has and then waits (SIO_IGNORE) with
+      // the position intact. capture has no such backlog to worry about, so stop recording right away.
+      // a linked pair has to stop as a whole, the playback side then plays out first.
+      if (pcm->hw.stream == SND_PCM_STREAM_CAPTURE || pcm->link) {
+         capture_fill((pcm->hw.stream == SND_PCM_STREAM_CAPTURE ? pcm : pcm->link), 0);
 
-      errno = 0;
-      while ((nfds = poll(pfd, nfds, timeout)) < 0) {
-         if (errno == EINVAL) {
-            WARNX1("poll EINVAL");
-            goto nodata;
-         } else if (errno == EINTR) {
-            WARNX1("poll EINTR");
-            goto nodata;
-         } else if (errno != EAGAIN)
-            goto nodata; // timeout
+         // a shared recording goes on for the others, just stop following it
+         if (!pcm->direct && !sio_stop(pcm->hdl))
+            return -1;
+
+         pcm->started = false;
+         if (pcm->link)
+            pcm->link->started = false;
       }
 
-      if (sio_revents(pcm->hdl, pfd) & want)
-         break;
+      pcm->state = SND_PCM_STATE_PAUSED;
+   } else {
+      if (pcm->state != SND_PCM_STATE_PAUSED)
+         return -EBADFD;
+
+      if (!pcm->started) {
+         if (!pcm->direct && !sio_start(pcm->hdl))
+            return -1;
+
+         // what was recorded while paused is skipped
+         if (pcm->direct)
+            pcm->direct_base = pcm->direct->position - pcm->position;
 
-      if (timeout > 0) {
-         const uint64_t delta = ((get_time_ns() - start) / 1e6);
-         if ((uint64_t)timeout <= delta)
-            goto nodata; // timeout;
+         pcm->started = true;
+         if (pcm->link)
+            pcm->link->started = true;
+      }
+
+      pcm->state = SND_PCM_STATE_RUNNING;
+      pcm->move_time = 0;
+      playback_flush(pcm, true);
 
-         timeout -= delta;
+      if (pcm->link && pcm->link->state == SND_PCM_STATE_PAUSED) {
+         pcm->link->state = SND_PCM_STATE_RUNNING;
+         pcm->link->move_time = 0;
+         playback_flush(pcm->link, true);
       }
    }
-   return 1;
 
-nodata:
+   pcm->trigger_time = get_time_ns();
+   link_follow(pcm);
    return 0;
 }
 
-snd_pcm_sframes_t
-snd_pcm_avail_update(snd_pcm_t *pcm)
+int
+snd_pcm_reset(snd_pcm_t *pcm)
 {
-   while (snd_pcm_wait(pcm, pcm->hw.period_time) && pcm->avail < pcm->sw.avail_min);
-   return MIN(pcm->avail, pcm->hw.par.appbufsz);
+   return (!snd_pcm_drain(pcm) && !snd_pcm_prepare(pcm) ? 0 : -1);
 }
 
-snd_pcm_sframes_t
-snd_pcm_avail(snd_pcm_t *pcm)
+size_t
+snd_pcm_hw_params_sizeof(void)
 {
-   return MIN(pcm->avail, pcm->hw.par.appbufsz);
+   return sizeof(snd_pcm_hw_params_t);
 }
 
-int
-snd_pcm_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
+void
+snd_pcm_hw_params_copy(snd_pcm_hw_params_t *dst, const snd_pcm_hw_params_t *src)
 {
-   if (delayp) *delayp = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->written - pcm->position : pcm->position - pcm->written);
-   return 0;
+   *dst = *src;
 }
 
 int
-snd_pcm_prepare(snd_pcm_t *pcm)
+snd_pcm_recover(snd_pcm_t *pcm, int err, int silent)
 {
-   if (!pcm->started && sio_start(pcm->hdl)) {
-      WARNX1("started");
-      pcm->started = true;
-      pcm->written = pcm->position = 0;
-      pcm->avail = pcm->hw.par.bufsz * (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK);
-      clock_gettime(CLOCK_MONOTONIC, &pcm->start_time);
+   if (err > 0)
+      err = -err;
+
+   switch (err) {
+      case -EINTR:
+         return 0;
+      case -EPIPE:
+      case -ESTRPIPE:
+         if (!silent)
+            WARNX("%s, recovering", (err == -EPIPE ? (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? "underrun" : "overrun") : "suspended"));
+         return snd_pcm_prepare(pcm);
    }
 
-   return (pcm->started ? 0 : -1);
+   return err;
 }
 
 int
-snd_pcm_start(snd_pcm_t *pcm)
+snd_pcm_hw_params_can_pause(const snd_pcm_hw_params_t *params)
 {
-   return snd_pcm_prepare(pcm);
+   return 1;
 }
 
 int
-snd_pcm_drain(snd_pcm_t *pcm)
+snd_pcm_hw_params_can_resume(const snd_pcm_hw_params_t *params)
 {
-   if (pcm->started && sio_stop(pcm->hdl)) {
-      WARNX1("stopped");
-      pcm->started = false;
-      pcm->avail = pcm->written = pcm->position = 0;
-   }
-
-   return (!pcm->started ? 0 : -1);
+   return 0;
 }
 
-int
-snd_pcm_drop(snd_pcm_t *pcm)
+static bool
+same_format(const struct sio_par *a, const struct sio_par *b)
 {
-   // FIXME: not correct, we need to do emulation
-   return snd_pcm_drain(pcm);
+   return (a->bits == b->bits && a->bps == b->bps && a->sig == b->sig && a->le == b->le && a->msb == b->msb &&
+           a->rchan == b->rchan && a->pchan == b->pchan && a->rate == b->rate && a->xrun == b->xrun);
 }
 
-int
-snd_pcm_resume(snd_pcm_t *pcm)
+static struct sio_par
+app_dev_par(const snd_pcm_t *pcm)
 {
-   // FIXME: not correct, we need to do emulation
-   return snd_pcm_drain(pcm);
+   // the device's parameters with the channels the app sees, they differ when remixed, see remix_par
+   struct sio_par dev = pcm->dev;
+   if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK) {
+      dev.pchan = pcm->hw.par.pchan;
+   } else {
+      dev.rchan = pcm->hw.par.rchan;
+   }
+   return dev;
 }
 
-int
-snd_pcm_pause(snd_pcm_t *pcm, int enable)
+static bool
+emulate_par(const snd_pcm_t *pcm, struct sio_par *par)
 {
-   // FIXME: not correct, we need to do emulation
-   return (enable ? snd_pcm_drain(pcm) : snd_pcm_start(pcm));
+   // a longer period or a smaller buffer than the device runs with can be done app side: round is only
+   // used as the granularity of the bookkeeping, and the unused part of the buffer is kept empty
+   const struct sio_par dev = app_dev_par(pcm);
+   if (!same_format(par, &dev) || par->round < pcm->dev.round)
+      return false;
+
+   const unsigned int round = par->round - par->round % pcm->dev.round;
+   const unsigned int appbufsz = MAX(par->appbufsz - par->appbufsz % round, round * 2);
+   if (appbufsz > pcm->dev.appbufsz)
+      return false;
+
+   par->round = round;
+   par->appbufsz = appbufsz;
+   par->bufsz = pcm->dev.bufsz;
+   return true;
 }
 
-int
-snd_pcm_reset(snd_pcm_t *pcm)
+static bool
+negotiate_spare(snd_pcm_t *pcm, struct sio_par *par)
 {
-   return (!snd_pcm_drain(pcm) && !snd_pcm_prepare(pcm) ? 0 : -1);
+   // the running stream stays untouched, a second connection tells what the device would give us
+   if (!pcm->spare && !(pcm->spare = device_connect(pcm->name, sndio_stream(pcm->hw.stream), pcm->mode)))
+      return false;
+
+   return device_setpar(pcm->spare, par);
 }
 
-size_t
-snd_pcm_hw_params_sizeof(void)
+static bool
+direct_par(const snd_pcm_t *pcm, struct sio_par *par)
 {
-   return sizeof(snd_pcm_hw_params_t);
+   // nothing to negotiate, the format is converted in process and the buffer is the stream's own queue.
+   // the rate and the block size are the shared stream's.
+   const struct sio_par *dev = &pcm->direct->par;
+   par->rate = dev->rate;
+   par->pchan = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? MIN(MAX(par->pchan, 1), dev->pchan) : 0);
+   par->rchan = (pcm->hw.stream == SND_PCM_STREAM_CAPTURE ? MIN(MAX(par->rchan, 1), dev->rchan) : 0);
+   par->round = MAX(par->round - par->round % dev->round, dev->round);
+   par->appbufsz = par->bufsz = MAX(par->appbufsz - par->appbufsz % par->round, 2 * par->round);
+   return true;
 }
 
-void
-snd_pcm_hw_params_copy(snd_pcm_hw_params_t *dst, const snd_pcm_hw_params_t *src)
+static void
+remix_par(const snd_pcm_t *pcm, const struct sio_par *req, struct sio_par *par)
 {
-   *dst = *src;
+   // channels the device doesn't have are mixed down (or up) in process to the ones it gave, as long as
+   // both are layouts we know the positions of. fewer recorded channels than that are a subset of its.
+   unsigned int *chan = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? &par->pchan : &par->rchan);
+   const unsigned int want = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? req->pchan : req->rchan);
+   if (want == *chan || (!remix_subset(pcm->hw.stream, want, *chan) && (!chmap_layout_for_channels(want) || !chmap_layout_for_channels(*chan))))
+      return;
+
+   WARNX("remixing %u channels to the device's %u", want, *chan);
+   *chan = want;
 }
 
 static bool
 apply_par(snd_pcm_t *pcm, const struct sio_par *old, struct sio_par *new_par)
 {
-   const bool was_started = pcm->started;
+   if (pcm->direct)
+      return direct_par(pcm, new_par);
+
+   // the devices of an aggregate can't be renegotiated on the side, only between streams
+   if (pcm->multi) {
+      if (pcm->started || !multi_par(pcm, new_par)) {
+         *new_par = *old;
+         return false;
+      }
+      return true;
+   }
 
-   if (was_started)
-      snd_pcm_drain(pcm);
+   if (pcm->started) {
+      // reconfiguring mid-stream, nothing is applied until snd_pcm_hw_params
+      if (!emulate_par(pcm, new_par) && !negotiate_spare(pcm, new_par)) {
+         *new_par = *old;
+         return false;
+      }
+      return true;
+   }
 
-   if (!new_par->__magic) {
-      // sndio sets magic to 0 after getpar, so it becomes "uninitialized".
-      // using "uninitialized" par in setpar fails. however, due to how asound
-      // design is, we really want to use our getparred pars in setpar, so
-      // lets force the initialized state here.
-      struct sio_par tmp;
-      sio_initpar(&tmp);
-      new_par->__magic = tmp.__magic;
-      new_par->bufsz = ~0U; // read-only
+   // already what the device runs with, e.g. snd_pcm_hw_params after the setters negotiated it
+   const struct sio_par dev = app_dev_par(pcm);
+   if (same_format(new_par, &dev) && new_par->round == pcm->dev.round && new_par->appbufsz == pcm->dev.appbufsz)
+      return true;
+
+   // not started, there's nothing to play out. frames queued before the start are dropped.
+   const bool was_prepared = (pcm->state == SND_PCM_STATE_PREPARED);
+
+   if (was_prepared)
+      snd_pcm_drop(pcm);
+
+   const struct sio_par req = *new_par;
+   const bool ret = device_setpar(pcm->hdl, new_par);
+   if (ret) {
+      pcm->dev = *new_par;
+      remix_par(pcm, &req, new_par);
+   } else {
+      *new_par = *old;
    }
 
-   if (!sio_setpar(pcm->hdl, new_par)) {
-      WARNX1("sio_setpar failed");
-      goto fail;
+   if (was_prepared)
+      snd_pcm_prepare(pcm);
+
+   return ret;
+}
+
+static int
+swap_device(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
+{
+   // sndio has to be reconfigured. hand over to the handle negotiated on the side, the frames still in
+   // the library queue carry over if the app format stays the same.
+   if (!negotiate_spare(pcm, &params->par))
+      return -1;
+
+   const bool was_running = (pcm->state == SND_PCM_STATE_RUNNING);
+   const bool carry = (params->format == pcm->hw.format && params->par.pchan == pcm->hw.par.pchan &&
+                       params->par.rchan == pcm->hw.par.rchan && pcm->hw.stream == SND_PCM_STREAM_PLAYBACK);
+
+   unsigned char *carried = NULL;
+   snd_pcm_uframes_t carried_frames = 0;
+   if (carry && pcm->queue.len > 0 && (carried = malloc(snd_pcm_frames_to_bytes(pcm, pcm->queue.len)))) {
+      for (unsigned char *ptr = carried; pcm->queue.len > 0;) {
+         const snd_pcm_uframes_t todo = MIN(pcm->queue.len, pcm->queue.size - pcm->queue.head);
+         memcpy(ptr, pcm->queue.data + snd_pcm_frames_to_bytes(pcm, pcm->queue.head), snd_pcm_frames_to_bytes(pcm, todo));
+         ptr += snd_pcm_frames_to_bytes(pcm, todo);
+         pcm->queue.head = (pcm->queue.head + todo) % pcm->queue.size;
+         pcm->queue.len -= todo;
+         carried_frames += todo;
+      }
    }
 
-   struct sio_par hpar;
-   if (!sio_getpar(pcm->hdl, &hpar)) {
-      WARNX1("sio_getpar failed");
-      goto fail;
+   if (pcm->state == SND_PCM_STATE_PAUSED)
+      pcm->state = SND_PCM_STATE_RUNNING;
+
+   // what's left in the queue (all of it if not carried) goes to the old device first,
+   // it running dry while draining isn't an xrun
+   playback_flush(pcm, true);
+   pcm->state = SND_PCM_STATE_DRAINING;
+
+   // sio_stop would block until the old buffer played out. playback instead leaves the old handle
+   // playing on its own and starts the new one right away, sndiod mixes the two.
+   uint64_t tail_ns = 0;
+   if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK && pcm->started) {
+      // sndio only starts once the buffer is full, top it up with silence so it plays what it has
+      if (!pcm->move_time) {
+         pcm->avail = pcm->dev.bufsz - MIN(pcm->sent, pcm->dev.bufsz);
+         device_write_silence(pcm, pcm->avail);
+      }
+
+      const uint64_t now = get_time_ns();
+      tail_ns = ((pcm->sent - interpolated_position(pcm, now)) * (uint64_t)1e9) / pcm->dev.rate;
+      retired_close(pcm, true);
+      sio_onmove(pcm->hdl, NULL, NULL);
+      pcm->retired = pcm->hdl;
+      pcm->retire_time = now + tail_ns;
+   } else {
+      if (pcm->started && !sio_stop(pcm->hdl))
+         WARNX1("sio_stop failed");
+
+      sio_close(pcm->hdl);
    }
 
-   *new_par = hpar;
-   bool ret = true;
-   goto out;
+   pcm->hdl = pcm->spare;
+   pcm->spare = NULL;
+   pcm->started = false;
+   sio_onmove(pcm->hdl, onmove, pcm);
+
+   pcm->dev = params->par;
+   pcm->hw = *params;
+   ensure_mmap_buffer(pcm);
+   ensure_queue_buffer(pcm);
+   reset_position(pcm);
+   pcm->state = SND_PCM_STATE_PREPARED;
+   WARNX("swapped, carried over %lu frames after %lu ns of the old device", carried_frames, (unsigned long)tail_ns);
+
+   if (was_running && pcm->hw.stream == SND_PCM_STREAM_PLAYBACK) {
+      // the new handle goes first with silence as long as the old one still plays, then the carried
+      // frames. it starts playing once that fills its buffer, until then the app has to top it up.
+      if (stream_start(pcm) < 0) {
+         free(carried);
+         return -1;
+      }
 
-fail:
-   *new_par = *old;
-   ret = false;
+      device_write_silence(pcm, MIN((tail_ns * pcm->dev.rate) / (uint64_t)1e9, pcm->avail));
+   }
 
-out:
-   if (was_started)
-      snd_pcm_prepare(pcm);
+   if (carried) {
+      carried_frames = MIN(carried_frames, pcm->avail);
+      queue_push(pcm, carried, carried_frames);
+      pcm->written += carried_frames;
+      pcm->avail -= carried_frames;
+      free(carried);
+   }
 
-   return ret;
+   if (pcm->state == SND_PCM_STATE_RUNNING) {
+      playback_flush(pcm, true);
+      return 0;
+   }
+
+   return (was_running ? stream_start(pcm) : 0);
 }
 
-static bool
-is_mmap_access(const snd_pcm_access_t access)
+int
+snd_pcm_link(snd_pcm_t *pcm1, snd_pcm_t *pcm2)
 {
-   return (access == SND_PCM_ACCESS_MMAP_INTERLEAVED || access == SND_PCM_ACCESS_MMAP_NONINTERLEAVED || access == SND_PCM_ACCESS_MMAP_COMPLEX);
+   // only a playback and a capture stream can be linked, they then share one SIO_PLAY | SIO_REC connection
+   // and with it the start and the position updates, so the two stay sample aligned
+   if (pcm1->link || pcm2->link || pcm1->hw.stream == pcm2->hw.stream || pcm1->mode != pcm2->mode) {
+      WARNX1("only an unlinked playback and capture pair with the same mode can be linked");
+      return -EINVAL;
+   }
+
+   if (pcm1->direct || pcm2->direct || pcm1->multi || pcm2->multi) {
+      WARNX1("pcms mixed in process or aggregated can't be linked");
+      return -EINVAL;
+   }
+
+   if (pcm1->started || pcm2->started)
+      return -EBUSY;
+
+   snd_pcm_t *play = (pcm1->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm1 : pcm2);
+   snd_pcm_t *rec = (play == pcm1 ? pcm2 : pcm1);
+
+   // sndio has a single encoding, rate and buffer for both directions
+   struct sio_par par = play->dev;
+   par.rchan = rec->dev.rchan;
+   const struct sio_par want = par;
+   if (par.bits != rec->dev.bits || par.bps != rec->dev.bps || par.sig != rec->dev.sig || par.le != rec->dev.le ||
+       par.msb != rec->dev.msb || par.rate != rec->dev.rate) {
+      WARNX1("playback and capture need the same device format and rate");
+      return -EINVAL;
+   }
+
+   struct sio_hdl *hdl;
+   if (!(hdl = device_connect(play->name, SIO_PLAY | SIO_REC, play->mode)))
+      return -ENODEV;
+
+   if (!device_setpar(hdl, &par) || !same_format(&par, &want)) {
+      WARNX1("device can't do full duplex with these parameters");
+      sio_close(hdl);
+      return -EINVAL;
+   }
+
+   snd_pcm_t *pcms[] = { play, rec };
+   for (size_t i = 0; i < ARRAY_SIZE(pcms); ++i) {
+      snd_pcm_t *pcm = pcms[i];
+      sio_close(pcm->hdl);
+      if (pcm->spare) sio_close(pcm->spare);
+      pcm->hdl = hdl;
+      pcm->spare = NULL;
+
+      // the full duplex stream may come with another buffer, thresholds based on the old one are stale
+      const bool resized = (pcm->hw.par.appbufsz != par.appbufsz);
+      pcm->dev = par;
+      pcm->hw.par.round = par.round;
+      pcm->hw.par.appbufsz = par.appbufsz;
+      pcm->hw.par.bufsz = par.bufsz;
+      if (resized)
+         sw_params_default(pcm);
+
+      if (pcm->queue.data) {
+         ensure_mmap_buffer(pcm);
+         ensure_queue_buffer(pcm);
+      }
+      reset_position(pcm);
+   }
+
+   play->link = rec;
+   rec->link = play;
+   sio_onmove(hdl, onmove_linked, play);
+   WARNX("linked, round: %u, appbufsz: %u", par.round, par.appbufsz);
+   return 0;
 }
 
-static void
-ensure_mmap_buffer(snd_pcm_t *pcm)
+int
+snd_pcm_unlink(snd_pcm_t *pcm)
 {
-   free(pcm->mmap.data);
-   pcm->mmap.data = NULL;
+   snd_pcm_t *peer;
+   if (!(peer = pcm->link))
+      return -EALREADY;
+
+   // each direction gets its own connection back, connect both first so a failure leaves the pair intact
+   snd_pcm_t *pcms[] = { pcm, peer };
+   struct sio_hdl *hdls[ARRAY_SIZE(pcms)] = {0};
+   struct sio_par pars[ARRAY_SIZE(pcms)];
+   for (size_t i = 0; i < ARRAY_SIZE(pcms); ++i) {
+      pars[i] = pcms[i]->dev;
+      if (!(hdls[i] = device_connect(pcms[i]->name, sndio_stream(pcms[i]->hw.stream), pcms[i]->mode)) || !device_setpar(hdls[i], &pars[i])) {
+         for (size_t j = 0; j <= i; ++j) {
+            if (hdls[j]) sio_close(hdls[j]);
+         }
+         return -ENODEV;
+      }
+   }
 
-   if (is_mmap_access(pcm->hw.access) && !(pcm->mmap.data = calloc(1, snd_pcm_frames_to_bytes(pcm, pcm->hw.par.bufsz))))
-      ERR1(EXIT_FAILURE, "realloc");
+   // the shared stream stops, both carry on from prepared
+   stream_stop(pcm, false);
+   sio_close(pcm->hdl);
+
+   for (size_t i = 0; i < ARRAY_SIZE(pcms); ++i) {
+      snd_pcm_t *p = pcms[i];
+      p->link = NULL;
+      p->hdl = hdls[i];
+      p->dev = pars[i];
+      sio_onmove(p->hdl, onmove, p);
+
+      if (p->state != SND_PCM_STATE_OPEN && p->state != SND_PCM_STATE_SETUP)
+         p->state = SND_PCM_STATE_PREPARED;
+   }
+
+   WARNX1("unlinked");
+   return 0;
 }
 
 int
 snd_pcm_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 {
+   if (pcm->link && memcmp(params, &pcm->hw, sizeof(*params))) {
+      WARNX1("unlink before changing the parameters of a linked pcm");
+      return -EBUSY;
+   }
+
+   if (pcm->started && !pcm->direct && !pcm->multi) {
+      if (!memcmp(params, &pcm->hw, sizeof(*params)))
+         return 0;
+
+      WARNX("reconfigure: rate: %u, round: %u, appbufsz: %u chan: %u", params->par.rate, params->par.round, params->par.appbufsz, (params->stream == SND_PCM_STREAM_PLAYBACK ? params->par.pchan : params->par.rchan));
+
+      // latency changes within what the device already has are applied app side without interrupting
+      // anything, the stream keeps its state
+      struct sio_par par = params->par;
+      if (params->format == pcm->hw.format && emulate_par(pcm, &par) && !memcmp(&par, &params->par, sizeof(par))) {
+         if (params->access != pcm->hw.access)
+            WARNX1("access can't change while running");
+
+         params->access = pcm->hw.access;
+         pcm->hw = *params;
+      } else if (swap_device(pcm, params) < 0) {
+         return -1;
+      }
+
+      sw_params_default(pcm);
+      return 0;
+   }
+
    if (memcmp(params, &pcm->hw, sizeof(*params))) {
       WARNX("requested: rate: %u, round: %u, appbufsz: %u chan: %u", params->par.rate, params->par.round, params->par.appbufsz, (params->stream == SND_PCM_STREAM_PLAYBACK ? params->par.pchan : params->par.rchan));
 
+      // a mixed stream has no device of its own to hand over to and an aggregate has several, they
+      // start over like after prepare
+      if ((pcm->direct || pcm->multi) && pcm->started)
+         snd_pcm_drop(pcm);
+
       const struct sio_par old = params->par;
       if (!apply_par(pcm, &old, &params->par))
          return -1;
 
       WARNX("set: rate: %u, round: %u, appbufsz: %u chan: %u", params->par.rate, params->par.round, params->par.appbufsz, (params->stream == SND_PCM_STREAM_PLAYBACK ? params->par.pchan : params->par.rchan));
+
+      // before anything is changed, running out of memory for it leaves the pcm as it was
+      int err;
+      if (pcm->direct && params->stream == SND_PCM_STREAM_CAPTURE && (err = dsnoop_reserve(pcm->direct, params->par.bufsz)) < 0)
+         return err;
+
       pcm->hw = *params;
+      if (pcm->direct)
+         pcm->dev = pcm->hw.par;
       ensure_mmap_buffer(pcm);
+      ensure_queue_buffer(pcm);
    }
 
+   // like ALSA, installing hw params resets the thresholds to their defaults
+   sw_params_default(pcm);
+
+   // for apps that don't know about snd_pcm_sndio_set_rewind_window
+   const char *env = getenv("ASOUND_REWIND_MS");
+   if (env && pcm->hw.stream == SND_PCM_STREAM_PLAYBACK)
+      pcm->rewind_window = (strtoul(env, NULL, 10) * pcm->hw.par.rate) / 1000;
+
+   // likewise for snd_pcm_sndio_set_adaptive_buffer, the app's buffer is the upper bound
+   if ((env = getenv("ASOUND_ADAPTIVE_MIN_MS")) && pcm->hw.stream == SND_PCM_STREAM_PLAYBACK)
+      snd_pcm_sndio_set_adaptive_buffer(pcm, (strtoul(env, NULL, 10) * pcm->hw.par.rate) / 1000, pcm->hw.par.appbufsz);
+
    return snd_pcm_prepare(pcm);
 }
 
@@ -859,10 +3783,8 @@ snd_pcm_format_mask_sizeof(void)
 int
 snd_pcm_format_mask_test(const snd_pcm_format_mask_t *mask, snd_pcm_format_t val)
 {
-   for (size_t i = 0; i < ARRAY_SIZE(SUPPORTED_FORMATS); ++i) {
-      if (SUPPORTED_FORMATS[i].fmt == val)
-         return true;
-   }
+   if (format_info_for_format(val))
+      return true;
    WARNX("format `0x%x` not supported by yet", val);
    return false;
 }
@@ -897,6 +3819,23 @@ snd_pcm_hw_params_get_format(const snd_pcm_hw_params_t *params, snd_pcm_format_t
    return 0;
 }
 
+static void
+set_format_par(snd_pcm_hw_params_t *params, snd_pcm_format_t val, const struct format_info *info)
+{
+   params->format = val;
+
+   if ((params->needs_conversion = !has_native_support(params, val)))
+      WARNX1("format needs to be transcoded!");
+
+   // companded samples are expanded to 16 bits, everything else is kept up to what sndio takes
+   const bool companded = (info->codec == CODEC_MU_LAW || info->codec == CODEC_A_LAW);
+   params->par.bits = (companded ? 16 : MIN(info->enc.bits, 24));
+   params->par.bps = (companded ? 2 : MIN(info->enc.bps, 4));
+   params->par.sig = (companded ? 1 : info->enc.sig);
+   params->par.le = (params->needs_conversion ? SIO_LE_NATIVE : info->enc.le);
+   params->par.msb = (companded ? 1 : info->enc.msb);
+}
+
 int
 snd_pcm_hw_params_set_format(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, snd_pcm_format_t val)
 {
@@ -906,18 +3845,9 @@ snd_pcm_hw_params_set_format(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, snd_pc
       return -1;
    }
 
-   params->format = val;
    WARNX("%s", info->name);
-
-   if ((params->needs_conversion = !has_native_support(params, val)))
-      WARNX1("format needs to be transcoded!");
-
    const struct sio_par old = params->par;
-   params->par.bits = MIN(info->enc.bits, 24);
-   params->par.bps = info->enc.bps;
-   params->par.sig = info->enc.sig;
-   params->par.le = (params->needs_conversion ? SIO_LE_NATIVE : info->enc.le);
-   params->par.msb = info->enc.msb;
+   set_format_par(params, val, info);
    return (apply_par(pcm, &old, &params->par) ? 0 : -1);
 }
 
@@ -993,11 +3923,30 @@ snd_pcm_hw_params_get_rate_numden(const snd_pcm_hw_params_t *params, unsigned in
    return 0;
 }
 
+static unsigned int
+device_rate_near(const snd_pcm_hw_params_t *params, unsigned int rate)
+{
+   unsigned int best = 0;
+   for (unsigned int c = 0; c < params->cap.nconf; ++c) {
+      for (unsigned int i = 0; i < SIO_NRATE; ++i) {
+         if ((params->cap.confs[c].rate & (1 << i)) && (!best || abs((int)params->cap.rate[i] - (int)rate) < abs((int)best - (int)rate)))
+            best = params->cap.rate[i];
+      }
+   }
+   return (best ? best : rate);
+}
+
 int
 snd_pcm_hw_params_set_rate_near(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, unsigned int *val, int *dir)
 {
    if (dir) *dir = 0;
-   if (val) WARNX("%u", *val);
+   if (!val) return 0;
+   WARNX("%u", *val);
+
+   // without resampling only the rates the device itself does are options
+   if (!params->rate_resample)
+      *val = device_rate_near(params, *val);
+
    assert(sizeof(params->par.rate) == sizeof(*val));
    return update(pcm, &params->par, &params->par.rate, val, sizeof(*val));
 }
@@ -1008,6 +3957,20 @@ snd_pcm_hw_params_set_rate(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, unsigned
    return snd_pcm_hw_params_set_rate_near(pcm, params, &val, &dir);
 }
 
+int
+snd_pcm_hw_params_set_rate_resample(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, unsigned int val)
+{
+   params->rate_resample = val;
+   return 0;
+}
+
+int
+snd_pcm_hw_params_get_rate_resample(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, unsigned int *val)
+{
+   if (val) *val = params->rate_resample;
+   return 0;
+}
+
 int
 snd_pcm_hw_params_get_rate_min(const snd_pcm_hw_params_t *params, unsigned int *val, int *dir)
 {
@@ -1197,10 +4160,22 @@ snd_pcm_sw_params_free(snd_pcm_sw_params_t *ptr)
    free(ptr);
 }
 
+void
+snd_pcm_sw_params_copy(snd_pcm_sw_params_t *dst, const snd_pcm_sw_params_t *src)
+{
+   *dst = *src;
+}
+
 int
 snd_pcm_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t *params)
 {
    pcm->sw = *params;
+
+   // lowering the start threshold below what's already written starts right away, same as ALSA
+   if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK && pcm->state == SND_PCM_STATE_PREPARED &&
+       pcm->written > 0 && pcm->written >= pcm->sw.start_threshold)
+      return stream_start(pcm);
+
    return 0;
 }
 
@@ -1219,13 +4194,178 @@ snd_pcm_sw_params_set_avail_min(snd_pcm_t *pcm, snd_pcm_sw_params_t *params, snd
    return 0;
 }
 
+int
+snd_pcm_sw_params_get_avail_min(const snd_pcm_sw_params_t *params, snd_pcm_uframes_t *val)
+{
+   if (val) *val = params->avail_min;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_get_boundary(const snd_pcm_sw_params_t *params, snd_pcm_uframes_t *val)
+{
+   // positions aren't exposed as wrapping ring pointers, so the boundary only matters as "never"
+   if (val) *val = SW_BOUNDARY;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_set_start_threshold(snd_pcm_t *pcm, snd_pcm_sw_params_t *params, snd_pcm_uframes_t val)
+{
+   WARNX("%lu", val);
+   params->start_threshold = val;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_get_start_threshold(const snd_pcm_sw_params_t *params, snd_pcm_uframes_t *val)
+{
+   if (val) *val = params->start_threshold;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_set_stop_threshold(snd_pcm_t *pcm, snd_pcm_sw_params_t *params, snd_pcm_uframes_t val)
+{
+   WARNX("%lu", val);
+   params->stop_threshold = val;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_get_stop_threshold(const snd_pcm_sw_params_t *params, snd_pcm_uframes_t *val)
+{
+   if (val) *val = params->stop_threshold;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_set_silence_threshold(snd_pcm_t *pcm, snd_pcm_sw_params_t *params, snd_pcm_uframes_t val)
+{
+   WARNX("%lu", val);
+
+   if (val > pcm->hw.par.appbufsz)
+      return -EINVAL;
+
+   params->silence_threshold = val;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_get_silence_threshold(const snd_pcm_sw_params_t *params, snd_pcm_uframes_t *val)
+{
+   if (val) *val = params->silence_threshold;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_set_silence_size(snd_pcm_t *pcm, snd_pcm_sw_params_t *params, snd_pcm_uframes_t val)
+{
+   WARNX("%lu", val);
+   params->silence_size = val;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_get_silence_size(const snd_pcm_sw_params_t *params, snd_pcm_uframes_t *val)
+{
+   if (val) *val = params->silence_size;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_set_tstamp_mode(snd_pcm_t *pcm, snd_pcm_sw_params_t *params, snd_pcm_tstamp_t val)
+{
+   WARNX("%u", val);
+   params->tstamp_mode = val;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_get_tstamp_mode(const snd_pcm_sw_params_t *params, snd_pcm_tstamp_t *val)
+{
+   if (val) *val = params->tstamp_mode;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_set_tstamp_type(snd_pcm_t *pcm, snd_pcm_sw_params_t *params, snd_pcm_tstamp_type_t val)
+{
+   WARNX("%u", val);
+
+#ifndef CLOCK_MONOTONIC_RAW
+   if (val == SND_PCM_TSTAMP_TYPE_MONOTONIC_RAW) {
+      WARNX1("CLOCK_MONOTONIC_RAW is not available");
+      return -1;
+   }
+#endif
+
+   if (val > SND_PCM_TSTAMP_TYPE_LAST)
+      return -1;
+
+   params->tstamp_type = val;
+   return 0;
+}
+
+int
+snd_pcm_sw_params_get_tstamp_type(const snd_pcm_sw_params_t *params, snd_pcm_tstamp_type_t *val)
+{
+   if (val) *val = params->tstamp_type;
+   return 0;
+}
+
 int
 snd_pcm_set_params(snd_pcm_t *pcm, snd_pcm_format_t format, snd_pcm_access_t access, unsigned int channels, unsigned int rate, int soft_resample, unsigned int latency)
 {
+   WARNX("rate: %u, chan: %u, latency: %uus, resample: %d", rate, channels, latency, soft_resample);
+
    snd_pcm_hw_params_t params;
-   return (!snd_pcm_hw_params_any(pcm, &params) && !snd_pcm_hw_params_set_format(pcm, &params, format) &&
-           !snd_pcm_hw_params_set_access(pcm, &params, access) && !snd_pcm_hw_params_set_channels(pcm, &params, channels) &&
-           !snd_pcm_hw_params_set_rate(pcm, &params, rate, 0) && !snd_pcm_hw_params(pcm, &params) ? 0 : -1);
+   snd_pcm_hw_params_any(pcm, &params);
+
+   const struct format_info *info;
+   if (!(info = format_info_for_format(format))) {
+      WARNX("format `0x%x` not supported yet", format);
+      return -EINVAL;
+   }
+
+   if (snd_pcm_hw_params_set_access(pcm, &params, access) != 0)
+      return -EINVAL;
+
+   // everything is filled in up front so sndio is only negotiated with once, in snd_pcm_hw_params
+   params.rate_resample = soft_resample;
+   if (!soft_resample && device_rate_near(&params, rate) != rate) {
+      WARNX("rate %u needs resampling", rate);
+      return -EINVAL;
+   }
+
+   set_format_par(&params, format, info);
+   params.par.rate = rate;
+   if (params.stream == SND_PCM_STREAM_PLAYBACK) {
+      params.par.pchan = channels;
+   } else {
+      params.par.rchan = channels;
+   }
+
+   // like ALSA, the latency is the buffer and a period a quarter of it. both in whole device blocks.
+   if (latency > 0) {
+      const unsigned int block = MAX((params.limits.block_ns * rate) / (uint64_t)1e9, 1);
+      const unsigned int appbufsz = ((uint64_t)latency * rate) / (uint64_t)1e6;
+      params.par.round = MAX(((appbufsz / 4) / block) * block, block);
+      params.par.appbufsz = MAX(((appbufsz + params.par.round / 2) / params.par.round) * params.par.round, params.par.round * 2);
+   }
+
+   if (snd_pcm_hw_params(pcm, &params) < 0)
+      return -EINVAL;
+
+   // sndio falls back to what it can do, only the rate and channels are hard requirements here
+   unsigned int got_channels;
+   snd_pcm_hw_params_get_channels(&pcm->hw, &got_channels);
+   if (pcm->hw.par.rate != rate || got_channels != channels) {
+      WARNX("got rate: %u, chan: %u", pcm->hw.par.rate, got_channels);
+      return -EINVAL;
+   }
+
+   return 0;
 }
 
 int
@@ -1236,35 +4376,135 @@ snd_pcm_get_params(snd_pcm_t *pcm, snd_pcm_uframes_t *buffer_size, snd_pcm_ufram
    return 0;
 }
 
+snd_pcm_chmap_query_t**
+snd_pcm_query_chmaps(snd_pcm_t *pcm)
+{
+   const bool pb = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK);
+   const unsigned int min = (pb ? pcm->hw.limits.pchan[0] : pcm->hw.limits.rchan[0]);
+   const unsigned int max = (pb ? pcm->hw.limits.pchan[1] : pcm->hw.limits.rchan[1]);
+
+   snd_pcm_chmap_query_t **maps;
+   if (!(maps = calloc(ARRAY_SIZE(chmap_layouts) + 1, sizeof(*maps)))) {
+      WARN1("calloc");
+      return NULL;
+   }
+
+   // the channels can be put in any order, see snd_pcm_set_chmap
+   for (size_t i = 0, n = 0; i < ARRAY_SIZE(chmap_layouts); ++i) {
+      const struct chmap_layout *layout = &chmap_layouts[i];
+      if (layout->channels < min || layout->channels > max)
+         continue;
+
+      if (!(maps[n] = calloc(1, sizeof(*maps[n]) + layout->channels * sizeof(maps[n]->map.pos[0])))) {
+         WARN1("calloc");
+         snd_pcm_free_chmaps(maps);
+         return NULL;
+      }
+
+      maps[n]->type = SND_CHMAP_TYPE_VAR;
+      maps[n]->map.channels = layout->channels;
+      memcpy(maps[n]->map.pos, layout->pos, layout->channels * sizeof(layout->pos[0]));
+      ++n;
+   }
+
+   return maps;
+}
+
+void
+snd_pcm_free_chmaps(snd_pcm_chmap_query_t **maps)
+{
+   if (!maps)
+      return;
+
+   for (snd_pcm_chmap_query_t **p = maps; *p; ++p)
+      free(*p);
+   free(maps);
+}
+
 snd_pcm_chmap_t*
 snd_pcm_get_chmap(snd_pcm_t *pcm)
 {
    const unsigned int nc = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->hw.par.pchan : pcm->hw.par.rchan);
 
-   if (!nc || nc > 2)
+   const struct chmap_layout *layout;
+   if (!(layout = chmap_layout_for_channels(nc)))
       return NULL;
 
    snd_pcm_chmap_t *map;
-   if (!(map = calloc(1, sizeof(*map) + nc))) {
+   if (!(map = calloc(1, sizeof(*map) + nc * sizeof(map->pos[0])))) {
       WARN1("calloc");
       return NULL;
    }
 
    map->channels = nc;
 
-   if (nc == 1) {
-      map->pos[0] = SND_CHMAP_MONO;
-   } else if (nc == 2) {
-      map->pos[0] = SND_CHMAP_FL;
-      map->pos[1] = SND_CHMAP_FR;
+   for (unsigned int c = 0; c < nc; ++c) {
+      if (!chmap_active(pcm)) {
+         map->pos[c] = layout->pos[c];
+      } else if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK) {
+         map->pos[pcm->chmap.src[c]] = layout->pos[c];
+      } else {
+         map->pos[c] = layout->pos[pcm->chmap.src[c]];
+      }
    }
 
    return map;
 }
 
+int
+snd_pcm_set_chmap(snd_pcm_t *pcm, const snd_pcm_chmap_t *map)
+{
+   if (pcm->state != SND_PCM_STATE_SETUP && pcm->state != SND_PCM_STATE_PREPARED)
+      return -EBADFD;
+
+   const unsigned int nc = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->hw.par.pchan : pcm->hw.par.rchan);
+   const struct chmap_layout *layout = chmap_layout_for_channels(nc);
+   if (!layout || map->channels != nc) {
+      WARNX("no channel map for %u channels", map->channels);
+      return -EINVAL;
+   }
+
+   // for each device channel, the app channel at the same position. a position given twice leaves another
+   // one out, so that's caught too.
+   unsigned char app[CMAT_NCHAN_MAX];
+   bool identity = true;
+   for (unsigned int c = 0; c < nc; ++c) {
+      unsigned int i;
+      for (i = 0; i < nc && map->pos[i] != layout->pos[c]; ++i);
+      if (i == nc) {
+         WARNX("channel map lacks position %u", layout->pos[c]);
+         return -EINVAL;
+      }
+
+      app[c] = i;
+      identity = identity && (i == c);
+   }
+
+   if (identity) {
+      pcm->chmap.channels = 0;
+      return 0;
+   }
+
+   for (unsigned int c = 0; c < nc; ++c) {
+      if (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK) {
+         pcm->chmap.src[c] = app[c];
+      } else {
+         pcm->chmap.src[app[c]] = c;
+      }
+   }
+
+   pcm->chmap.channels = nc;
+   return 0;
+}
+
 struct _snd_pcm_status {
-   struct timespec start, end;
+   snd_htimestamp_t trigger, tstamp, audio_tstamp, driver_tstamp;
+   snd_pcm_audio_tstamp_config_t audio_tstamp_config;
+   snd_pcm_audio_tstamp_report_t audio_tstamp_report;
+   snd_pcm_uframes_t avail, avail_max;
    snd_pcm_sframes_t delay;
+   snd_pcm_state_t state;
+   double rate_ratio;
 };
 
 size_t
@@ -1285,34 +4525,285 @@ snd_pcm_status_free(snd_pcm_status_t *obj)
    free(obj);
 }
 
+void
+snd_pcm_status_copy(snd_pcm_status_t *dst, const snd_pcm_status_t *src)
+{
+   *dst = *src;
+}
+
 int
 snd_pcm_status(snd_pcm_t *pcm, snd_pcm_status_t *status)
 {
-   *status = (snd_pcm_status_t){ .start = pcm->start_time };
-   snd_pcm_delay(pcm, &status->delay);
-   return (clock_gettime(CLOCK_MONOTONIC, &status->end) == 0 ? 0 : -1);
+   // everything is derived from the onmove bookkeeping: nothing is flushed, drained or polled, so
+   // status polling never talks to sndio. the audio tstamp config is an input set by the caller beforehand.
+   const snd_pcm_audio_tstamp_config_t config = status->audio_tstamp_config;
+   *status = (snd_pcm_status_t){ .audio_tstamp_config = config };
+
+   // with SND_PCM_TSTAMP_ENABLE report the exact position of the last update, otherwise interpolate to now
+   const uint64_t now = get_time_ns();
+   check_xrun(pcm, now);
+   const uint64_t at = (pcm->sw.tstamp_mode == SND_PCM_TSTAMP_ENABLE && pcm->move_time ? pcm->move_time : now);
+   const snd_pcm_uframes_t position = (at == now ? interpolated_position(pcm, now) : pcm->position);
+   const uint64_t audio_ns = (pcm->hw.par.rate ? (position * (uint64_t)1e9) / pcm->hw.par.rate : 0);
+
+   if (pcm->started)
+      ns_to_tstamp(pcm, pcm->trigger_time, &status->trigger);
+
+   ns_to_tstamp(pcm, at, &status->tstamp);
+   status->driver_tstamp = status->tstamp;
+   status->delay = (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? pcm->sent + pcm->queue.len - position : position - pcm->written);
+   status->state = pcm->state;
+   // the frames the device moved since the last onmove are free already, so avail and delay are the same moment
+   status->avail = MIN(app_avail(pcm) + (position - pcm->position), pcm->hw.par.appbufsz);
+   status->avail_max = MAX(MIN(pcm->avail_max, pcm->hw.par.appbufsz), status->avail);
+   pcm->avail_max = 0;
+
+   int64_t report_ns = audio_ns;
+   if (config.report_delay && pcm->hw.par.rate) {
+      const int64_t delay_ns = (status->delay * (int64_t)1e9) / (int64_t)pcm->hw.par.rate;
+      report_ns = MAX(report_ns + (pcm->hw.stream == SND_PCM_STREAM_PLAYBACK ? delay_ns : -delay_ns), 0);
+   }
+
+   status->audio_tstamp = (snd_htimestamp_t){ .tv_sec = report_ns / (uint64_t)1e9, .tv_nsec = report_ns % (uint64_t)1e9 };
+   status->audio_tstamp_report = (snd_pcm_audio_tstamp_report_t){
+      .valid = 1,
+      .actual_type = 0, // SND_PCM_AUDIO_TSTAMP_TYPE_COMPAT
+      .accuracy_report = (pcm->hw.par.rate > 0),
+      // interpolated positions are only as good as the nominal rate over at most one block
+      .accuracy = (pcm->hw.par.rate && at == now ? (pcm->hw.par.round * (uint64_t)1e9) / pcm->hw.par.rate : 0),
+   };
+   snd_pcm_sndio_get_rate_ratio(pcm, &status->rate_ratio);
+   return 0;
 }
 
 void
 snd_pcm_status_get_htstamp(const snd_pcm_status_t *obj, snd_htimestamp_t *ptr)
 {
-   snd_htimestamp_t ats = {0};
-   if ((obj->end.tv_nsec - obj->start.tv_nsec) < 0) {
-      ats.tv_sec = obj->end.tv_sec - obj->start.tv_sec - 1;
-      ats.tv_nsec = (uint64_t)1e9 + obj->end.tv_nsec - obj->start.tv_nsec;
-   } else {
-      ats.tv_sec = obj->end.tv_sec - obj->start.tv_sec;
-      ats.tv_nsec = obj->end.tv_nsec - obj->start.tv_nsec;
-   }
-   *ptr = ats;
+   *ptr = obj->tstamp;
 }
 
 void
 snd_pcm_status_get_tstamp(const snd_pcm_status_t *obj, snd_timestamp_t *ptr)
 {
-   snd_htimestamp_t ats;
-   snd_pcm_status_get_htstamp(obj, &ats);
-   *ptr = (snd_timestamp_t){ .tv_sec = ats.tv_sec, .tv_usec = ats.tv_nsec / (uint64_t)1e3 };
+   *ptr = (snd_timestamp_t){ .tv_sec = obj->tstamp.tv_sec, .tv_usec = obj->tstamp.tv_nsec / (uint64_t)1e3 };
+}
+
+void
+snd_pcm_status_get_trigger_htstamp(const snd_pcm_status_t *obj, snd_htimestamp_t *ptr)
+{
+   *ptr = obj->trigger;
+}
+
+void
+snd_pcm_status_get_trigger_tstamp(const snd_pcm_status_t *obj, snd_timestamp_t *ptr)
+{
+   *ptr = (snd_timestamp_t){ .tv_sec = obj->trigger.tv_sec, .tv_usec = obj->trigger.tv_nsec / (uint64_t)1e3 };
+}
+
+void
+snd_pcm_status_get_audio_htstamp(const snd_pcm_status_t *obj, snd_htimestamp_t *ptr)
+{
+   *ptr = obj->audio_tstamp;
+}
+
+void
+snd_pcm_status_get_driver_htstamp(const snd_pcm_status_t *obj, snd_htimestamp_t *ptr)
+{
+   *ptr = obj->driver_tstamp;
+}
+
+void
+snd_pcm_status_get_audio_htstamp_report(const snd_pcm_status_t *obj, snd_pcm_audio_tstamp_report_t *audio_tstamp_report)
+{
+   *audio_tstamp_report = obj->audio_tstamp_report;
+}
+
+void
+snd_pcm_status_set_audio_htstamp_config(snd_pcm_status_t *obj, snd_pcm_audio_tstamp_config_t *audio_tstamp_config)
+{
+   obj->audio_tstamp_config = *audio_tstamp_config;
+}
+
+snd_pcm_state_t
+snd_pcm_status_get_state(const snd_pcm_status_t *obj)
+{
+   return obj->state;
+}
+
+snd_pcm_uframes_t
+snd_pcm_status_get_avail(const snd_pcm_status_t *obj)
+{
+   return obj->avail;
+}
+
+snd_pcm_uframes_t
+snd_pcm_status_get_avail_max(const snd_pcm_status_t *obj)
+{
+   return obj->avail_max;
+}
+
+snd_pcm_uframes_t
+snd_pcm_status_get_overrange(const snd_pcm_status_t *obj)
+{
+   return 0;
+}
+
+double
+snd_pcm_sndio_status_get_rate_ratio(const snd_pcm_status_t *obj)
+{
+   return obj->rate_ratio;
+}
+
+int
+snd_pcm_sndio_set_rewind_window(snd_pcm_t *pcm, snd_pcm_uframes_t frames)
+{
+   WARNX("%lu", frames);
+
+   if (pcm->hw.stream != SND_PCM_STREAM_PLAYBACK)
+      return -EINVAL;
+
+   pcm->rewind_window = frames;
+   return 0;
+}
+
+int
+snd_pcm_sndio_get_rewind_window(snd_pcm_t *pcm, snd_pcm_uframes_t *frames)
+{
+   if (frames) *frames = rewind_window(pcm);
+   return 0;
+}
+
+int
+snd_pcm_sndio_set_adaptive_buffer(snd_pcm_t *pcm, snd_pcm_uframes_t min, snd_pcm_uframes_t max)
+{
+   WARNX("%lu - %lu", min, max);
+
+   if (pcm->hw.stream != SND_PCM_STREAM_PLAYBACK || min > max)
+      return -EINVAL;
+
+   // starts from the top and works its way down
+   const snd_pcm_uframes_t lo = MAX(min, pcm->hw.par.round * 2);
+   pcm->adapt = (struct adapt){ .min = lo, .max = (max ? MAX(lo, max) : 0) };
+   pcm->adapt.size = pcm->adapt.max;
+   adapt_reset_window(pcm, get_time_ns());
+   return 0;
+}
+
+int
+snd_pcm_sndio_get_adaptive_buffer(snd_pcm_t *pcm, snd_pcm_uframes_t *frames)
+{
+   if (frames) *frames = effective_buffer(pcm);
+   return 0;
+}
+
+static double
+estimated_position(const snd_pcm_t *pcm, const uint64_t now)
+{
+   // like interpolated_position, but from the filtered clock and keeping the fraction
+   const struct drift *d = &pcm->drift;
+   if (!d->updates || d->time <= 0 || d->period <= 0)
+      return interpolated_position(pcm, now);
+
+   const double frames = ((double)now - d->time) / d->period;
+   return pcm->position + MIN(MAX(frames, 0.0), (double)(pcm->sent - pcm->position));
+}
+
+snd_pcm_sframes_t
+snd_pcm_sndio_writei_at(snd_pcm_t *pcm, const void *buffer, snd_pcm_uframes_t size, const snd_htimestamp_t *tstamp)
+{
+   if (pcm->hw.stream != SND_PCM_STREAM_PLAYBACK || !tstamp)
+      return -EINVAL;
+
+   if (snd_pcm_state(pcm) == SND_PCM_STATE_XRUN)
+      return -EPIPE;
+
+   if (pcm->state != SND_PCM_STATE_PREPARED && pcm->state != SND_PCM_STATE_RUNNING) {
+      WARNX1("playback isn't prepared or running");
+      return -EBADFD;
+   }
+
+   if (pcm->state == SND_PCM_STATE_PREPARED && stream_start(pcm) < 0)
+      return -EPIPE;
+
+   // the timeline only exists once the device plays, and sndio only starts playing a full buffer.
+   // until the first onmove fill it up with silence, so that playing starts now.
+   if (!pcm->move_time) {
+      playback_flush(pcm, true);
+      const snd_pcm_uframes_t fill = pcm->sent - pcm->position;
+      if (fill < pcm->dev.bufsz && pcm->dev.bufsz - fill > pcm->avail) {
+         WARNX1("the device buffer is bigger than the pcm's, it has to be running");
+         return -EBADFD;
+      }
+
+      if (fill < pcm->dev.bufsz)
+         device_write_silence(pcm, pcm->dev.bufsz - fill);
+   }
+
+   // where the next written frame ends up: everything written so far plays before it
+   const uint64_t now = get_time_ns();
+   const uint64_t at = (uint64_t)tstamp->tv_sec * (uint64_t)1e9 + (uint64_t)tstamp->tv_nsec;
+   const double period = (pcm->drift.updates && pcm->drift.period > 0 ? pcm->drift.period : 1e9 / pcm->hw.par.rate);
+   const double queued = (double)(pcm->sent + pcm->queue.len) - estimated_position(pcm, now);
+   const double frames = ((double)at - (double)now) / period - queued;
+   const long long offset = (long long)(frames + (frames < 0 ? -0.5 : 0.5));
+
+   // too late, the part that should have played already is dropped so the rest stays on time
+   const snd_pcm_uframes_t skip = (offset < 0 ? MIN((snd_pcm_uframes_t)-offset, size) : 0);
+   WARNX("offset: %lld frames", offset);
+
+   // too early, silence until then
+   for (snd_pcm_uframes_t pad = (offset > 0 ? (snd_pcm_uframes_t)offset : 0); pad > 0;) {
+      const snd_pcm_uframes_t todo = MIN(pad, app_avail(pcm));
+      if (!todo) {
+         // the silence already queued counts as written, a retry with the same timestamp continues
+         if (pcm->mode == SND_PCM_NONBLOCK)
+            return -EAGAIN;
+
+         playback_flush(pcm, !wakes_on_moves(pcm));
+         const int ret = snd_pcm_wait(pcm, -1);
+         if (ret < 0)
+            return ret;
+         continue;
+      }
+
+      queue_push_silence(pcm, todo);
+      pcm->written += todo;
+      pcm->avail -= todo;
+      pad -= todo;
+      playback_flush(pcm, false);
+   }
+
+   if (skip == size)
+      return skip;
+
+   const snd_pcm_sframes_t ret = snd_pcm_writei(pcm, (const unsigned char*)buffer + snd_pcm_frames_to_bytes(pcm, skip), size - skip);
+   return (ret < 0 ? (skip ? (snd_pcm_sframes_t)skip : ret) : ret + (snd_pcm_sframes_t)skip);
+}
+
+int
+snd_pcm_sndio_get_xruns(snd_pcm_t *pcm, unsigned long *xruns)
+{
+   if (xruns) *xruns = pcm->xruns;
+   return 0;
+}
+
+int
+snd_pcm_sndio_get_dropped(snd_pcm_t *pcm, snd_pcm_uframes_t *frames)
+{
+   snd_pcm_uframes_t dropped = 0;
+   for (unsigned int i = 0; pcm->multi && i < pcm->multi->nslaves; ++i)
+      dropped += pcm->multi->slaves[i].dropped;
+
+   if (frames) *frames = dropped;
+   return 0;
+}
+
+int
+snd_pcm_sndio_get_rate_ratio(snd_pcm_t *pcm, double *ratio)
+{
+   const bool settled = (pcm->started && pcm->drift.updates >= DRIFT_SETTLE_UPDATES && pcm->hw.par.rate);
+   if (ratio) *ratio = (settled ? (1e9 / pcm->hw.par.rate) / pcm->drift.period : 1.0);
+   return (settled ? 0 : -1);
 }
 
 snd_pcm_sframes_t
@@ -14,9 +14,14 @@
  * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
+#include <pthread.h>
 #include <string.h>
 #include "dsp.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 int aparams_ctltovol[128] = {
 	    0,
 	  256,	  266,	  276,	  287,	  299,	  310,	  323,	  335,
@@ -427,7 +432,7 @@ resamp_init(struct resamp *p, unsigned int iblksz,
 	p->diff = 0;
 	p->nch = nch;
 	p->ctx_start = 0;
-	memset(p->ctx, 0, sizeof(p->ctx));
+	memset(p->ctx, 0, nch * RESAMP_NCTX * sizeof(adata_t));
 #ifdef DEBUG
 	if (log_level >= 3) {
 		log_puts("resamp: ");
@@ -494,6 +499,110 @@ enc_do_float(struct conv *p, unsigned char *in, unsigned char *out, int todo)
 	}
 }
 
+/*
+ * convert a 64-bit float to adata_t, clipping to -1:1, boundaries
+ * excluded, NaN being silence
+ */
+static inline int
+f64_to_adata(double x)
+{
+	x *= ADATA_UNIT;
+	if (x >= ADATA_UNIT - 1)
+		return ADATA_UNIT - 1;
+	if (x <= -ADATA_UNIT)
+		return -ADATA_UNIT;
+	if (!(x > -ADATA_UNIT))
+		return 0;
+	return (int)x;
+}
+
+#if ADATA_BITS == 16 && defined(__SSE2__)
+/*
+ * same as f64_to_adata() for two samples, as 32-bit integers
+ */
+static inline __m128i
+f64x2_to_adata(__m128d x)
+{
+	x = _mm_and_pd(x, _mm_cmpord_pd(x, x));
+	x = _mm_mul_pd(x, _mm_set1_pd(ADATA_UNIT));
+	x = _mm_min_pd(x, _mm_set1_pd(ADATA_UNIT - 1));
+	x = _mm_max_pd(x, _mm_set1_pd(-ADATA_UNIT));
+	return _mm_cvttpd_epi32(x);
+}
+#endif
+
+/*
+ * encode "todo" frames from native to 64-bit float
+ */
+void
+enc_do_float64(struct conv *p, unsigned char *in, unsigned char *out, int todo)
+{
+	unsigned int f;
+	adata_t *idata;
+	unsigned long long s;
+	unsigned int i;
+	unsigned char *odata;
+	int obnext;
+	int osnext;
+	union {
+		double d; // assumes ieee754
+		unsigned long long x;
+	} u;
+#if ADATA_BITS == 16 && defined(__SSE2__)
+	__m128i v, lo, hi;
+	__m128d scale;
+#endif
+
+#ifdef DEBUG
+	if (log_level >= 4) {
+		log_puts("enc: copying ");
+		log_putu(todo);
+		log_puts(" frames\n");
+	}
+#endif
+	idata = (adata_t *)in;
+	odata = out;
+	obnext = p->bnext;
+	osnext = p->snext;
+	f = todo * p->nch;
+
+#if ADATA_BITS == 16 && defined(__SSE2__)
+	/*
+	 * same byte order as the host, widen 8 samples at a time
+	 */
+	if (ADATA_LE && obnext == 1) {
+		scale = _mm_set1_pd(1. / ADATA_UNIT);
+		for (; f >= 8; f -= 8) {
+			v = _mm_loadu_si128((__m128i *)idata);
+			lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+			hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+			_mm_storeu_pd((double *)odata,
+			    _mm_mul_pd(_mm_cvtepi32_pd(lo), scale));
+			_mm_storeu_pd((double *)odata + 2,
+			    _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(lo, 8)), scale));
+			_mm_storeu_pd((double *)odata + 4,
+			    _mm_mul_pd(_mm_cvtepi32_pd(hi), scale));
+			_mm_storeu_pd((double *)odata + 6,
+			    _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(hi, 8)), scale));
+			idata += 8;
+			odata += 8 * sizeof(double);
+		}
+	}
+#endif
+
+	odata += p->bfirst;
+	for (; f > 0; f--) {
+		u.d = (double)*idata++ / ADATA_UNIT;
+		s = u.x;
+		for (i = 8; i > 0; i--) {
+			*odata = (unsigned char)s;
+			s >>= 8;
+			odata += obnext;
+		}
+		odata += osnext;
+	}
+}
+
 /*
  * encode "todo" frames from native to foreign encoding
  */
@@ -773,6 +882,73 @@ dec_do_float(struct conv *p, unsigned char *in, unsigned char *out, int todo)
 	}
 }
 
+/*
+ * decode "todo" frames from 64-bit float to native
+ */
+void
+dec_do_float64(struct conv *p, unsigned char *in, unsigned char *out, int todo)
+{
+	unsigned int f;
+	unsigned int i;
+	unsigned long long s = 0;
+	unsigned char *idata;
+	int ibnext;
+	int isnext;
+	adata_t *odata;
+	union {
+		double d; // assumes ieee754
+		unsigned long long x;
+	} u;
+#if ADATA_BITS == 16 && defined(__SSE2__)
+	__m128i lo, hi;
+#endif
+
+#ifdef DEBUG
+	if (log_level >= 4) {
+		log_puts("dec: copying ");
+		log_putu(todo);
+		log_puts(" frames\n");
+	}
+#endif
+	idata = in;
+	odata = (adata_t *)out;
+	ibnext = p->bnext;
+	isnext = p->snext;
+	f = todo * p->nch;
+
+#if ADATA_BITS == 16 && defined(__SSE2__)
+	/*
+	 * same byte order as the host, narrow 8 samples at a time, the
+	 * final pack saturates
+	 */
+	if (ADATA_LE && ibnext == -1) {
+		for (; f >= 8; f -= 8) {
+			lo = _mm_unpacklo_epi64(
+			    f64x2_to_adata(_mm_loadu_pd((double *)idata)),
+			    f64x2_to_adata(_mm_loadu_pd((double *)idata + 2)));
+			hi = _mm_unpacklo_epi64(
+			    f64x2_to_adata(_mm_loadu_pd((double *)idata + 4)),
+			    f64x2_to_adata(_mm_loadu_pd((double *)idata + 6)));
+			_mm_storeu_si128((__m128i *)odata, _mm_packs_epi32(lo, hi));
+			idata += 8 * sizeof(double);
+			odata += 8;
+		}
+	}
+#endif
+
+	idata += p->bfirst;
+	for (; f > 0; f--) {
+		for (i = 8; i > 0; i--) {
+			s <<= 8;
+			s |= *idata;
+			idata += ibnext;
+		}
+		idata += isnext;
+		u.x = s;
+		*odata++ = f64_to_adata(u.d);
+	}
+}
+
 /*
  * convert samples from ulaw/alaw to adata_t
  */
@@ -799,6 +975,92 @@ dec_do_ulaw(struct conv *p, unsigned char *in,
 		*odata++ = map[*idata++] << (ADATA_BITS - 16);
 }
 
+/*
+ * 16-bit linear to ulaw/alaw, indexed by the 14 (ulaw) or 13 (alaw)
+ * significant bits, offset to be positive; filled once, on first use
+ * by any thread
+ */
+static unsigned char enc_ulawmap[1 << 14], enc_alawmap[1 << 13];
+static pthread_once_t enc_lawmaps_once = PTHREAD_ONCE_INIT;
+
+static int
+enc_lawseg(int val, int top)
+{
+	int seg;
+
+	for (seg = 0; seg < 8 && val > top; seg++)
+		top = (top << 1) | 1;
+	return seg;
+}
+
+static void
+enc_lawmaps_init(void)
+{
+	int i, val, seg, mask;
+
+	for (i = 0; i < (1 << 14); i++) {
+		val = i - (1 << 13);
+		if (val < 0) {
+			val = -val;
+			mask = 0x7f;
+		} else
+			mask = 0xff;
+		if (val > 8159)
+			val = 8159;
+		val += 0x84 >> 2;
+		seg = enc_lawseg(val, 0x3f);
+		enc_ulawmap[i] = (seg >= 8) ? (0x7f ^ mask) :
+		    (((seg << 4) | ((val >> (seg + 1)) & 0xf)) ^ mask);
+	}
+	for (i = 0; i < (1 << 13); i++) {
+		val = i - (1 << 12);
+		if (val >= 0)
+			mask = 0xd5;
+		else {
+			mask = 0x55;
+			val = -val - 1;
+		}
+		seg = enc_lawseg(val, 0x1f);
+		enc_alawmap[i] = (seg >= 8) ? (0x7f ^ mask) :
+		    (((seg << 4) | ((val >> (seg < 2 ? 1 : seg)) & 0xf)) ^ mask);
+	}
+}
+
+/*
+ * convert samples from adata_t to ulaw/alaw
+ */
+void
+enc_do_ulaw(struct conv *p, unsigned char *in,
+    unsigned char *out, int todo, int is_alaw)
+{
+	unsigned int f;
+	adata_t *idata;
+	unsigned char *odata;
+	int s;
+
+#ifdef DEBUG
+	if (log_level >= 4) {
+		log_puts("enc: copying ");
+		log_putu(todo);
+		log_puts(" frames\n");
+	}
+#endif
+	pthread_once(&enc_lawmaps_once, enc_lawmaps_init);
+	idata = (adata_t *)in;
+	odata = out;
+	if (is_alaw) {
+		for (f = todo * p->nch; f > 0; f--) {
+			s = *idata++ >> (ADATA_BITS - 16);
+			*odata++ = enc_alawmap[(s >> 3) + (1 << 12)];
+		}
+	} else {
+		for (f = todo * p->nch; f > 0; f--) {
+			s = *idata++ >> (ADATA_BITS - 16);
+			*odata++ = enc_ulawmap[(s >> 2) + (1 << 13)];
+		}
+	}
+}
+
 /*
  * initialize decoder from foreign to native encoding
  */
@@ -837,6 +1099,165 @@ dec_init(struct conv *p, struct aparams *par, int nch)
 #endif
 }
 
+#if ADATA_BITS == 24 && defined(__SSE2__)
+/*
+ * ADATA_MUL() of 4 samples by the non-negative volume in every lane of
+ * "v", "v9" being it shifted left by 9. SSE2 only has unsigned 32x32
+ * products, so the bits 23..54 of the 64-bit products are taken from
+ * those and corrected by vol << 32 for negative samples.
+ */
+static inline __m128i
+adata_mul4(__m128i x, __m128i v, __m128i v9)
+{
+	__m128i even, odd, mask, neg;
+
+	mask = _mm_set_epi32(0, -1, 0, -1);
+	neg = _mm_srai_epi32(x, 31);
+	even = _mm_srli_epi64(_mm_mul_epu32(x, v), ADATA_BITS - 1);
+	odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(x, 32), v),
+	    ADATA_BITS - 1);
+	x = _mm_or_si128(_mm_and_si128(even, mask), _mm_slli_epi64(odd, 32));
+	return _mm_sub_epi32(x, _mm_and_si128(neg, v9));
+}
+
+/*
+ * clip 4 sums to the adata_t range, they can't overflow 32 bits
+ */
+static inline __m128i
+adata_clip4(__m128i x)
+{
+	__m128i lim, m;
+
+	lim = _mm_set1_epi32(ADATA_UNIT - 1);
+	m = _mm_cmpgt_epi32(x, lim);
+	x = _mm_or_si128(_mm_and_si128(m, lim), _mm_andnot_si128(m, x));
+	lim = _mm_set1_epi32(-ADATA_UNIT);
+	m = _mm_cmplt_epi32(x, lim);
+	return _mm_or_si128(_mm_and_si128(m, lim), _mm_andnot_si128(m, x));
+}
+#endif
+
+/*
+ * mix "n" contiguous samples, used when input and output frames
+ * have the same channels so frames need no skipping
+ */
+static void
+cmap_add_flat(adata_t *idata, adata_t *odata, int vol, int n)
+{
+	int y;
+
+#if ADATA_BITS == 16 && defined(__SSE2__)
+	__m128i x, lo, hi, v;
+
+	if (vol == ADATA_UNIT) {
+		for (; n >= 8; n -= 8) {
+			x = _mm_loadu_si128((__m128i *)idata);
+			x = _mm_adds_epi16(_mm_loadu_si128((__m128i *)odata), x);
+			_mm_storeu_si128((__m128i *)odata, x);
+			idata += 8;
+			odata += 8;
+		}
+	} else if (vol >= 0 && vol < ADATA_UNIT) {
+		/*
+		 * bits 15..30 of the 32-bit products, the same as ADATA_MUL()
+		 */
+		v = _mm_set1_epi16(vol);
+		for (; n >= 8; n -= 8) {
+			x = _mm_loadu_si128((__m128i *)idata);
+			lo = _mm_mullo_epi16(x, v);
+			hi = _mm_mulhi_epi16(x, v);
+			x = _mm_or_si128(_mm_slli_epi16(hi, 1),
+			    _mm_srli_epi16(lo, 15));
+			x = _mm_adds_epi16(_mm_loadu_si128((__m128i *)odata), x);
+			_mm_storeu_si128((__m128i *)odata, x);
+			idata += 8;
+			odata += 8;
+		}
+	}
+#elif ADATA_BITS == 24 && defined(__SSE2__)
+	__m128i x, v, v9;
+
+	if (vol == ADATA_UNIT) {
+		for (; n >= 4; n -= 4) {
+			x = _mm_loadu_si128((__m128i *)idata);
+			x = _mm_add_epi32(_mm_loadu_si128((__m128i *)odata), x);
+			_mm_storeu_si128((__m128i *)odata, adata_clip4(x));
+			idata += 4;
+			odata += 4;
+		}
+	} else if (vol >= 0 && vol < ADATA_UNIT) {
+		v = _mm_set1_epi32(vol);
+		v9 = _mm_set1_epi32((int)((unsigned int)vol << 9));
+		for (; n >= 4; n -= 4) {
+			x = adata_mul4(_mm_loadu_si128((__m128i *)idata), v, v9);
+			x = _mm_add_epi32(_mm_loadu_si128((__m128i *)odata), x);
+			_mm_storeu_si128((__m128i *)odata, adata_clip4(x));
+			idata += 4;
+			odata += 4;
+		}
+	}
+#endif
+	for (; n > 0; n--) {
+		y = *odata + ADATA_MUL(*idata, vol);
+		if (y >= ADATA_UNIT)
+			y = ADATA_UNIT - 1;
+		else if (y < -ADATA_UNIT)
+			y = -ADATA_UNIT;
+		*odata = y;
+		idata++;
+		odata++;
+	}
+}
+
+/*
+ * copy "n" contiguous samples, see cmap_add_flat()
+ */
+static void
+cmap_copy_flat(adata_t *idata, adata_t *odata, int vol, int n)
+{
+#if ADATA_BITS == 16 && defined(__SSE2__)
+	__m128i x, lo, hi, v;
+
+	if (vol == ADATA_UNIT) {
+		memcpy(odata, idata, n * sizeof(adata_t));
+		return;
+	} else if (vol >= 0 && vol < ADATA_UNIT) {
+		v = _mm_set1_epi16(vol);
+		for (; n >= 8; n -= 8) {
+			x = _mm_loadu_si128((__m128i *)idata);
+			lo = _mm_mullo_epi16(x, v);
+			hi = _mm_mulhi_epi16(x, v);
+			x = _mm_or_si128(_mm_slli_epi16(hi, 1),
+			    _mm_srli_epi16(lo, 15));
+			_mm_storeu_si128((__m128i *)odata, x);
+			idata += 8;
+			odata += 8;
+		}
+	}
+#elif ADATA_BITS == 24 && defined(__SSE2__)
+	__m128i x, v, v9;
+
+	if (vol == ADATA_UNIT) {
+		memcpy(odata, idata, n * sizeof(adata_t));
+		return;
+	} else if (vol >= 0 && vol < ADATA_UNIT) {
+		v = _mm_set1_epi32(vol);
+		v9 = _mm_set1_epi32((int)((unsigned int)vol << 9));
+		for (; n >= 4; n -= 4) {
+			x = adata_mul4(_mm_loadu_si128((__m128i *)idata), v, v9);
+			_mm_storeu_si128((__m128i *)odata, x);
+			idata += 4;
+			odata += 4;
+		}
+	}
+#endif
+	for (; n > 0; n--) {
+		*odata = ADATA_MUL(*idata, vol);
+		idata++;
+		odata++;
+	}
+}
+
 /*
  * mix "todo" input frames on the output with the given volume
  */
@@ -862,6 +1283,11 @@ cmap_add(struct cmap *p, void *in, void *out, int vol, int todo)
 	nch = p->nch;
 	v = vol;
 
+	if (istart == 0 && inext == 0 && ostart == 0 && onext == 0) {
+		cmap_add_flat(idata, odata, v, todo * nch);
+		return;
+	}
+
 	/*
 	 * map/mix input on the output
 	 */
@@ -908,6 +1334,11 @@ cmap_copy(struct cmap *p, void *in, void *out, int vol, int todo)
 	nch = p->nch;
 	v = vol;
 
+	if (istart == 0 && inext == 0 && ostart == 0 && onext == 0) {
+		cmap_copy_flat(idata, odata, v, todo * nch);
+		return;
+	}
+
 	/*
 	 * copy to the output buffer
 	 */
@@ -976,3 +1407,248 @@ cmap_init(struct cmap *p,
 	}
 #endif
 }
+
+#if ADATA_BITS == 16 && defined(__SSE2__)
+/*
+ * mix one frame of "nin" <= 8 channels, the 8 samples from "idata" on
+ * (the ones past the frame have zero coefficients), with the matrix
+ * rows in "c", to "nout" channels. Each _mm_madd_epi16() gives 4 sums
+ * of 2 products of a row, the 4 rows of a group are then summed
+ * across and saturated to 16 bits by the pack.
+ */
+static inline void
+cmat_frame(__m128i *c, adata_t *idata, adata_t *odata, unsigned int nout)
+{
+	__m128i x, a, b, r[2];
+	adata_t y[8];
+	unsigned int g, ngrp, j;
+
+	x = _mm_loadu_si128((__m128i *)idata);
+	r[0] = r[1] = _mm_setzero_si128();
+	ngrp = (nout + 3) / 4;
+	for (g = 0; g < ngrp; g++) {
+		a = _mm_madd_epi16(x, c[4 * g]);
+		b = _mm_madd_epi16(x, c[4 * g + 1]);
+		a = _mm_add_epi32(_mm_unpacklo_epi32(a, b),
+		    _mm_unpackhi_epi32(a, b));
+		r[g] = _mm_madd_epi16(x, c[4 * g + 2]);
+		b = _mm_madd_epi16(x, c[4 * g + 3]);
+		b = _mm_add_epi32(_mm_unpacklo_epi32(r[g], b),
+		    _mm_unpackhi_epi32(r[g], b));
+		r[g] = _mm_add_epi32(_mm_unpacklo_epi64(a, b),
+		    _mm_unpackhi_epi64(a, b));
+		r[g] = _mm_srai_epi32(r[g], CMAT_SHIFT);
+	}
+	x = _mm_packs_epi32(r[0], r[1]);
+	if (nout == 8) {
+		_mm_storeu_si128((__m128i *)odata, x);
+		return;
+	}
+	_mm_storeu_si128((__m128i *)y, x);
+	for (j = 0; j < nout; j++)
+		odata[j] = y[j];
+}
+#endif
+
+/*
+ * mix "todo" frames through the matrix, the output is saturated. Each
+ * output sample is the sum of the products shifted by CMAT_SHIFT, the
+ * scalar path skips zero coefficients, most of a remix matrix
+ */
+void
+cmat_do(struct cmat *p, void *in, void *out, int todo)
+{
+	adata_t *idata, *odata;
+	int idx[CMAT_NCHAN_MAX * CMAT_NCHAN_MAX], cnt[CMAT_NCHAN_MAX];
+	int *coef, *k;
+	int i, j, nin, nout;
+	long long y;
+#if ADATA_BITS == 16 && defined(__SSE2__)
+	__m128i c[CMAT_NCHAN_MAX];
+	short row[CMAT_NCHAN_MAX];
+	int sum, simd, ntail, nsimd, f;
+#endif
+
+#ifdef DEBUG
+	if (log_level >= 4) {
+		log_puts("cmat: mixing ");
+		log_puti(todo);
+		log_puts(" frames\n");
+	}
+#endif
+	idata = in;
+	odata = out;
+	nin = p->nin;
+	nout = p->nout;
+
+	/*
+	 * the non-zero coefficients of each row
+	 */
+	for (j = 0; j < nout; j++) {
+		coef = p->coef + j * nin;
+		cnt[j] = 0;
+		for (i = 0; i < nin; i++) {
+			if (coef[i] != 0)
+				idx[j * CMAT_NCHAN_MAX + cnt[j]++] = i;
+		}
+	}
+
+#if ADATA_BITS == 16 && defined(__SSE2__)
+	/*
+	 * 32-bit sums of 16-bit products can't overflow if the
+	 * coefficients fit in 16 bits and each row sums to less than 4
+	 */
+	simd = 1;
+	for (j = 0; j < nout; j++) {
+		coef = p->coef + j * nin;
+		sum = 0;
+		for (i = 0; i < nin; i++) {
+			if (coef[i] < -32768 || coef[i] > 32767)
+				simd = 0;
+			else
+				sum += coef[i] < 0 ? -coef[i] : coef[i];
+		}
+		if (sum >= 4 * CMAT_UNIT)
+			simd = 0;
+	}
+	if (simd) {
+		for (j = 0; j < CMAT_NCHAN_MAX; j++) {
+			for (i = 0; i < CMAT_NCHAN_MAX; i++) {
+				row[i] = (j < nout && i < nin) ?
+				    p->coef[j * nin + i] : 0;
+			}
+			c[j] = _mm_loadu_si128((__m128i *)row);
+		}
+
+		/*
+		 * each frame loads 8 samples, the last ones are left to
+		 * the scalar loop so they don't read past the input
+		 */
+		ntail = (CMAT_NCHAN_MAX - 1) / nin;
+		nsimd = (todo > ntail) ? todo - ntail : 0;
+		for (f = nsimd; f > 0; f--) {
+			cmat_frame(c, idata, odata, nout);
+			idata += nin;
+			odata += nout;
+		}
+		todo -= nsimd;
+	}
+#endif
+
+	for (; todo > 0; todo--) {
+		for (j = 0; j < nout; j++) {
+			coef = p->coef + j * nin;
+			k = idx + j * CMAT_NCHAN_MAX;
+			y = 0;
+			for (i = 0; i < cnt[j]; i++)
+				y += (long long)idata[k[i]] * coef[k[i]];
+			y >>= CMAT_SHIFT;
+			if (y >= ADATA_UNIT)
+				y = ADATA_UNIT - 1;
+			else if (y < -ADATA_UNIT)
+				y = -ADATA_UNIT;
+			*odata++ = y;
+		}
+		idata += nin;
+	}
+}
+
+#if ADATA_BITS == 16 && defined(__SSE2__)
+/*
+ * lane c of the result is lane c + d of "x", SSE2 only shifts by
+ * constants
+ */
+static inline __m128i
+cperm_shift(__m128i x, int d)
+{
+	switch (d) {
+	case -7: return _mm_slli_si128(x, 14);
+	case -6: return _mm_slli_si128(x, 12);
+	case -5: return _mm_slli_si128(x, 10);
+	case -4: return _mm_slli_si128(x, 8);
+	case -3: return _mm_slli_si128(x, 6);
+	case -2: return _mm_slli_si128(x, 4);
+	case -1: return _mm_slli_si128(x, 2);
+	case 1: return _mm_srli_si128(x, 2);
+	case 2: return _mm_srli_si128(x, 4);
+	case 3: return _mm_srli_si128(x, 6);
+	case 4: return _mm_srli_si128(x, 8);
+	case 5: return _mm_srli_si128(x, 10);
+	case 6: return _mm_srli_si128(x, 12);
+	case 7: return _mm_srli_si128(x, 14);
+	default: return x;
+	}
+}
+#endif
+
+/*
+ * reorder the "nch" <= 8 channels of "todo" frames in place: channel
+ * c of each frame becomes its channel src[c]. With SSE2, when whole
+ * frames fit a vector several times (2 or 4 channels), 8 samples are
+ * moved at once: each distinct distance between a channel and its
+ * source is a shift, masked to the lanes taking their sample from that
+ * far. SSE2 has no shuffle by a variable pattern, so with one frame per
+ * vector the shifts and the overlapping loads and stores cost more than
+ * the scalar loop; 6 and 8 channels stay scalar.
+ */
+void
+cperm_do(const unsigned char *src, int nch, void *data, int todo)
+{
+	adata_t *d, frame[CMAT_NCHAN_MAX];
+	int c;
+#if ADATA_BITS == 16 && defined(__SSE2__)
+	__m128i x, y, mask[15];
+	short m[8];
+	int dist[15], ndist, per, nsimd, f, k, l;
+#endif
+
+	d = data;
+#if ADATA_BITS == 16 && defined(__SSE2__)
+	if (nch > 4 || 8 % nch != 0)
+		goto scalar;
+	per = 8 / nch;
+	ndist = 0;
+	for (k = 0; k < 15; k++) {
+		for (l = 0; l < 8; l++)
+			m[l] = (src[l % nch] - l % nch == k - 7) ? -1 : 0;
+		mask[ndist] = _mm_loadu_si128((__m128i *)m);
+		if (_mm_movemask_epi8(mask[ndist]))
+			dist[ndist++] = k - 7;
+	}
+
+	/*
+	 * the frames that don't fill a whole vector are left to the
+	 * scalar loop
+	 */
+	nsimd = todo / per;
+	for (f = nsimd; f > 0; f--) {
+		x = _mm_loadu_si128((__m128i *)d);
+		y = _mm_setzero_si128();
+		for (k = 0; k < ndist; k++) {
+			y = _mm_or_si128(y,
+			    _mm_and_si128(cperm_shift(x, dist[k]), mask[k]));
+		}
+		_mm_storeu_si128((__m128i *)d, y);
+		d += per * nch;
+	}
+	todo -= nsimd * per;
+scalar:
+#endif
+	for (; todo > 0; todo--) {
+		memcpy(frame, d, nch * sizeof(adata_t));
+		for (c = 0; c < nch; c++)
+			*d++ = frame[src[c]];
+	}
+}
+
+/*
+ * initialize channel matrix with all coefficients zero, the
+ * caller sets the ones it needs
+ */
+void
+cmat_init(struct cmat *p, int nin, int nout)
+{
+	p->nin = nin;
+	p->nout = nout;
+	memset(p->coef, 0, sizeof(p->coef));
+}
@@ -113,7 +113,7 @@ struct aparams {
 struct resamp {
 #define RESAMP_NCTX	2
 	unsigned int ctx_start;
-	adata_t ctx[NCHAN_MAX * RESAMP_NCTX];
+	adata_t *ctx;			/* nch * RESAMP_NCTX, from the caller */
 	unsigned int iblksz, oblksz;
 	int diff;
 	int nch;
@@ -137,6 +137,22 @@ struct cmap {
 	int nch;
 };
 
+/*
+ * channel matrix: each output channel is the sum of all input
+ * channels, weighted by its row of coefficients. Coefficients are
+ * fixed point with CMAT_SHIFT fractional bits, rows whose magnitudes
+ * sum to less than 4 * CMAT_UNIT are mixed with SIMD where available.
+ */
+#define CMAT_NCHAN_MAX	8		/* max channels on either side */
+#define CMAT_SHIFT	14
+#define CMAT_UNIT	(1 << CMAT_SHIFT)	/* coefficient of 1 */
+
+struct cmat {
+	int nin;
+	int nout;
+	int coef[CMAT_NCHAN_MAX * CMAT_NCHAN_MAX];	/* nout rows of nin */
+};
+
 #define MIDI_TO_ADATA(m)	(aparams_ctltovol[m] << (ADATA_BITS - 16))
 extern int aparams_ctltovol[128];
 
@@ -150,15 +166,21 @@ void resamp_getcnt(struct resamp *, int *, int *);
 void resamp_do(struct resamp *, adata_t *, adata_t *, int, int);
 void resamp_init(struct resamp *, unsigned int, unsigned int, int);
 void enc_do_float(struct conv *, unsigned char *, unsigned char *, int);
+void enc_do_float64(struct conv *, unsigned char *, unsigned char *, int);
 void enc_do(struct conv *, unsigned char *, unsigned char *, int);
+void enc_do_ulaw(struct conv *, unsigned char *, unsigned char *, int, int);
 void enc_sil_do(struct conv *, unsigned char *, int);
 void enc_init(struct conv *, struct aparams *, int);
 void dec_do(struct conv *, unsigned char *, unsigned char *, int);
 void dec_do_float(struct conv *, unsigned char *, unsigned char *, int);
+void dec_do_float64(struct conv *, unsigned char *, unsigned char *, int);
 void dec_do_ulaw(struct conv *, unsigned char *, unsigned char *, int, int);
 void dec_init(struct conv *, struct aparams *, int);
 void cmap_add(struct cmap *, void *, void *, int, int);
 void cmap_copy(struct cmap *, void *, void *, int, int);
 void cmap_init(struct cmap *, int, int, int, int, int, int, int, int);
+void cmat_do(struct cmat *, void *, void *, int);
+void cmat_init(struct cmat *, int, int);
+void cperm_do(const unsigned char *, int, void *, int);
 
 #endif /* !defined(DSP_H) */
@@ -29,6 +29,19 @@ do_debug(void)
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
+#define CACHE_LINE_SIZE 64
+
+static inline void*
+c_aligned_calloc(size_t size)
+{
+   void *ptr;
+   if (posix_memalign(&ptr, CACHE_LINE_SIZE, size))
+      return NULL;
+
+   memset(ptr, 0, size);
+   return ptr;
+}
+
 static inline char*
 c_strdup(const char *str)
 {